@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <metadata-common.h>
+#include <metadata-file.h>
+
+using reven::metadata::Metadata;
+
+namespace {
+
+struct Options {
+	std::string directory;
+	std::size_t passes = 5;
+	bool json = false;
+	bool write = true;
+};
+
+///
+/// Resources of a corpus sharing a format and a body size
+/// generate_corpus names them <format>-<size>-<index>.<format>, the group is what comes before the last '-'.
+///
+struct Group {
+	std::string format;
+	std::uint64_t size = 0;
+	std::vector<std::string> filenames;
+};
+
+struct Result {
+	std::string group;
+	std::string scenario;
+	std::size_t operations;
+	double p50_us;
+	double p90_us;
+	double p99_us;
+	double max_us;
+	double files_per_second;
+};
+
+std::map<std::pair<std::string, std::uint64_t>, Group> list_groups(const std::string& directory) {
+	std::map<std::pair<std::string, std::uint64_t>, Group> groups;
+
+	for (const auto& entry : boost::filesystem::directory_iterator(directory)) {
+		if (!boost::filesystem::is_regular_file(entry.status())) {
+			continue;
+		}
+
+		const auto stem = entry.path().filename().string();
+		const auto size_end = stem.rfind('-');
+		const auto format_end = stem.find('-');
+		if (size_end == std::string::npos || format_end == size_end) {
+			continue;
+		}
+
+		const auto format = stem.substr(0, format_end);
+		const auto size = std::strtoull(stem.substr(format_end + 1, size_end - format_end - 1).c_str(), nullptr, 10);
+
+		auto& group = groups[{format, size}];
+		group.format = format;
+		group.size = size;
+		group.filenames.push_back(entry.path().string());
+	}
+
+	for (auto& group : groups) {
+		std::sort(group.second.filenames.begin(), group.second.filenames.end());
+	}
+
+	return groups;
+}
+
+// Write back the dirty pages of the file and evict it from the page cache. Best effort: tmpfs can't evict anything.
+void evict(const std::string& filename) {
+	const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+
+	::fdatasync(fd);
+	::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	::close(fd);
+}
+
+std::string size_name(std::uint64_t size) {
+	static const char* const suffixes[] = {"B", "K", "M", "G", "T"};
+
+	std::size_t suffix = 0;
+	while (size >= 1024 && size % 1024 == 0 && suffix + 1 < sizeof(suffixes) / sizeof(suffixes[0])) {
+		size /= 1024;
+		++suffix;
+	}
+	return std::to_string(size) + suffixes[suffix];
+}
+
+double percentile(const std::vector<double>& sorted, double ratio) {
+	const auto index = static_cast<std::size_t>(ratio * static_cast<double>(sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+// Time `fn(filename)` on each file of the group, `passes` times, after an untimed `prepare(filename)`
+template <typename Prepare, typename Fn>
+Result measure(const Group& group, const char* scenario, std::size_t passes, Prepare prepare, Fn fn) {
+	std::vector<double> latencies;
+	double total_us = 0;
+
+	for (std::size_t pass = 0; pass < passes; ++pass) {
+		for (const auto& filename : group.filenames) {
+			prepare(filename);
+
+			const auto start = std::chrono::steady_clock::now();
+			fn(filename);
+			const auto duration = std::chrono::steady_clock::now() - start;
+
+			const auto us = static_cast<double>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()
+			) / 1000.;
+			latencies.push_back(us);
+			total_us += us;
+		}
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	return {
+		group.format + "-" + size_name(group.size), scenario, latencies.size(),
+		percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), latencies.back(),
+		static_cast<double>(latencies.size()) / (total_us / 1e6)
+	};
+}
+
+std::vector<Result> bench_group(const Group& group, const Options& options) {
+	std::vector<Result> results;
+	const auto nothing = [](const std::string&) {};
+	const auto read = [](const std::string& filename) {
+		reven::metadata::from_resource(filename.c_str());
+	};
+
+	// Cold: every file is evicted right before being read, so only the pages read by from_resource are loaded
+	results.push_back(measure(group, "from_resource cold", options.passes, evict, read));
+
+	// Warm: the files have just been read, so their first pages are in the page cache
+	for (const auto& filename : group.filenames) {
+		read(filename);
+	}
+	results.push_back(measure(group, "from_resource warm", options.passes, nothing, read));
+
+	if (options.write) {
+		std::vector<Metadata> metadata;
+		for (const auto& filename : group.filenames) {
+			metadata.push_back(reven::metadata::from_resource(filename.c_str()));
+		}
+
+		std::size_t index = 0;
+		results.push_back(measure(group, "set_metadata", options.passes, nothing, [&](const std::string& filename) {
+			reven::metadata::set_metadata(filename.c_str(), metadata[index++ % metadata.size()]);
+		}));
+	}
+
+	return results;
+}
+
+void print_text(const std::vector<Result>& results) {
+	std::cout << std::left << std::setw(16) << "resources" << std::setw(22) << "operation" << std::right
+	          << std::setw(8) << "count" << std::setw(12) << "p50 (us)" << std::setw(12) << "p90 (us)"
+	          << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)" << std::setw(14) << "files/s" << std::endl;
+
+	for (const auto& result : results) {
+		std::cout << std::left << std::setw(16) << result.group << std::setw(22) << result.scenario << std::right
+		          << std::setw(8) << result.operations << std::fixed << std::setprecision(1)
+		          << std::setw(12) << result.p50_us << std::setw(12) << result.p90_us
+		          << std::setw(12) << result.p99_us << std::setw(12) << result.max_us
+		          << std::setw(14) << std::setprecision(0) << result.files_per_second << std::endl;
+	}
+}
+
+void print_json(const std::vector<Result>& results) {
+	std::cout << "{\n  \"benchmarks\": [\n";
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		const auto& result = results[i];
+		std::cout << "    {\"name\": \"" << result.group << "/" << result.scenario << "\", \"operations\": "
+		          << result.operations << std::fixed << std::setprecision(3)
+		          << ", \"p50_us\": " << result.p50_us << ", \"p90_us\": " << result.p90_us
+		          << ", \"p99_us\": " << result.p99_us << ", \"max_us\": " << result.max_us
+		          << ", \"files_per_second\": " << result.files_per_second << "}"
+		          << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	std::cout << "  ]\n}" << std::endl;
+}
+
+void usage(const char* name) {
+	std::cerr << "Usage: " << name << " DIRECTORY [--passes N] [--format text|json] [--read-only]\n"
+	          << "\n"
+	          << "Measure from_resource and set_metadata on a corpus created by generate_corpus, per format and size.\n"
+	          << "With --read-only, set_metadata isn't measured and the resources aren't modified."
+	          << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--passes" && i + 1 < argc) {
+			options.passes = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--format" && i + 1 < argc && (argv[i + 1] == std::string("text") ||
+		                                                 argv[i + 1] == std::string("json"))) {
+			options.json = argv[++i] == std::string("json");
+		} else if (arg == "--read-only") {
+			options.write = false;
+		} else if (arg[0] != '-' && options.directory.empty()) {
+			options.directory = arg;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (options.directory.empty()) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Result> results;
+	try {
+		for (const auto& group : list_groups(options.directory)) {
+			const auto group_results = bench_group(group.second, options);
+			results.insert(results.end(), group_results.begin(), group_results.end());
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (options.json) {
+		print_json(results);
+	} else {
+		print_text(results);
+	}
+
+	return EXIT_SUCCESS;
+}
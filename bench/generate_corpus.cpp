@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include <metadata-common.h>
+#include <metadata-file.h>
+
+#include <rvnsqlite/resource_database.h>
+
+#include "metadata-bin-header.h"
+
+using reven::metadata::Metadata;
+using reven::metadata::ResourceType;
+using reven::metadata::Version;
+
+namespace {
+
+// Size of the chunks the bodies are written by
+constexpr std::size_t chunk_size = 1 << 20;
+
+enum class Format {
+	Binary,
+	Json,
+	Sqlite,
+};
+
+const char* format_name(Format format) {
+	switch (format) {
+		case Format::Binary: return "bin";
+		case Format::Json: return "json";
+		case Format::Sqlite: return "sqlite";
+	}
+	return "";
+}
+
+struct Options {
+	std::string directory;
+	std::size_t count = 10;
+	std::vector<std::uint64_t> sizes = {0, 1 << 20, 64 << 20};
+	std::vector<Format> formats = {Format::Binary, Format::Json, Format::Sqlite};
+	bool sparse = false;
+	std::string sqlite_template = SQLITE_TEMPLATE;
+};
+
+// Pseudo-random content, so the bodies can't be compressed nor deduplicated by the filesystem
+std::vector<char> make_chunk() {
+	std::mt19937_64 gen(42);
+	std::vector<char> chunk(chunk_size);
+	for (auto& c : chunk) {
+		c = static_cast<char>('a' + gen() % 26);
+	}
+	return chunk;
+}
+
+void write_all(int fd, const char* data, std::size_t size) {
+	while (size > 0) {
+		const ssize_t written = ::write(fd, data, size);
+		if (written < 0) {
+			throw std::runtime_error(std::string("Can't write: ") + std::strerror(errno));
+		}
+		data += written;
+		size -= static_cast<std::size_t>(written);
+	}
+}
+
+void write_body(int fd, std::uint64_t size, bool sparse, const std::vector<char>& chunk) {
+	if (sparse) {
+		const off_t end = ::lseek(fd, 0, SEEK_END);
+		if (end < 0 || ::ftruncate(fd, end + static_cast<off_t>(size)) != 0) {
+			throw std::runtime_error(std::string("Can't extend: ") + std::strerror(errno));
+		}
+		return;
+	}
+
+	for (std::uint64_t written = 0; written < size; written += chunk_size) {
+		write_all(fd, chunk.data(), static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size, size - written)));
+	}
+}
+
+int create_file(const std::string& filename) {
+	const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error("Can't create " + filename + ": " + std::strerror(errno));
+	}
+	return fd;
+}
+
+// A header with empty metadata, followed by the body
+void create_binary(const std::string& filename, std::uint64_t size, bool sparse, const std::vector<char>& chunk) {
+	namespace binheader = reven::metadata::binheader;
+
+	std::vector<char> header(binheader::header_size, '\0');
+	std::memcpy(header.data(), binheader::magic, sizeof(binheader::magic) - 1);
+	const std::uint32_t metadata_version = 1;
+	std::memcpy(header.data() + 8, &metadata_version, sizeof(metadata_version));
+
+	const int fd = create_file(filename);
+	try {
+		write_all(fd, header.data(), header.size());
+		write_body(fd, size, sparse, chunk);
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	::close(fd);
+}
+
+// A document with placeholder metadata before its body, as the writer only replaces existing metadata
+void create_json(const std::string& filename, std::uint64_t size, const std::vector<char>& chunk) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file << "{\n\t\"metadata\": {\"metadata_version\": \"1\", \"type\": \"1\", \"format_version\": \"0.0.0\", "
+	        "\"tool_name\": \"\", \"tool_version\": \"0.0.0\", \"tool_info\": \"\", \"generation_date\": \"0\"},\n"
+	        "\t\"body\": \"";
+	for (std::uint64_t written = 0; written < size; written += chunk_size) {
+		file.write(chunk.data(), static_cast<std::streamsize>(std::min<std::uint64_t>(chunk_size, size - written)));
+	}
+	file << "\"\n}\n";
+
+	if (!file) {
+		throw std::runtime_error("Can't write " + filename);
+	}
+}
+
+void check_sqlite(sqlite3* db, int result, const std::string& filename) {
+	if (result != SQLITE_OK && result != SQLITE_DONE) {
+		throw std::runtime_error("Can't write the body of " + filename + ": " + sqlite3_errmsg(db));
+	}
+}
+
+void copy_file(const std::string& from, const std::string& to) {
+	std::ifstream source(from, std::ios::binary);
+	if (!source) {
+		throw std::runtime_error("Can't open " + from);
+	}
+
+	std::ofstream destination(to, std::ios::binary | std::ios::trunc);
+	destination << source.rdbuf();
+	if (!destination) {
+		throw std::runtime_error("Can't write " + to);
+	}
+}
+
+// A copy of the template resource database, whose schema and metadata row come from rvnsqlite, with a table of blobs
+// as its body. The body is the only part written here, with the sqlite library rvnsqlite is built upon.
+void create_sqlite(const std::string& filename, const std::string& sqlite_template, std::uint64_t size) {
+	::unlink(filename.c_str());
+	copy_file(sqlite_template, filename);
+
+	// Fails early if the template isn't a resource database
+	reven::sqlite::ResourceDatabase::open(filename.c_str(), false);
+
+	sqlite3* db = nullptr;
+	if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+		sqlite3_close(db);
+		throw std::runtime_error("Can't open " + filename);
+	}
+
+	sqlite3_stmt* stmt = nullptr;
+	try {
+		check_sqlite(db, sqlite3_exec(db, "BEGIN; CREATE TABLE body (data blob);", nullptr, nullptr, nullptr), filename);
+
+		check_sqlite(db, sqlite3_prepare_v2(db, "INSERT INTO body VALUES (?)", -1, &stmt, nullptr), filename);
+		for (std::uint64_t written = 0; written < size; written += chunk_size) {
+			const auto blob_size = static_cast<int>(std::min<std::uint64_t>(chunk_size, size - written));
+			check_sqlite(db, sqlite3_bind_zeroblob(stmt, 1, blob_size), filename);
+			check_sqlite(db, sqlite3_step(stmt), filename);
+			check_sqlite(db, sqlite3_reset(stmt), filename);
+		}
+
+		check_sqlite(db, sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr), filename);
+	} catch (...) {
+		sqlite3_finalize(stmt);
+		sqlite3_close(db);
+		throw;
+	}
+
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+}
+
+Metadata make_metadata(Format format, std::size_t index) {
+	const ResourceType types[] = {ResourceType::TraceBin, ResourceType::KernelDescription, ResourceType::Strings};
+	const auto type = types[static_cast<std::size_t>(format)];
+
+	auto builder = reven::metadata::MetadataBuilder(Metadata(
+		type, Version(1, 0, 0), "generate_corpus", Version(2, 1, 0), "Synthetic resource " + std::to_string(index),
+		std::chrono::system_clock::time_point{std::chrono::seconds(1600000000 + index)}
+	));
+	if (format == Format::Json) {
+		builder.custom("index", std::to_string(index)).custom("origin", "generate_corpus");
+	}
+	return builder.build();
+}
+
+std::vector<std::string> split(const std::string& str) {
+	std::vector<std::string> parts;
+	std::size_t start = 0;
+	while (start <= str.size()) {
+		const auto end = std::min(str.find(',', start), str.size());
+		parts.push_back(str.substr(start, end - start));
+		start = end + 1;
+	}
+	return parts;
+}
+
+// A size in bytes, with an optional K, M or G suffix
+std::uint64_t parse_size(const std::string& str) {
+	char* end = nullptr;
+	std::uint64_t size = std::strtoull(str.c_str(), &end, 10);
+	if (end == str.c_str()) {
+		throw std::invalid_argument("Invalid size: " + str);
+	}
+
+	const std::string suffix = end;
+	if (suffix == "K") {
+		size <<= 10;
+	} else if (suffix == "M") {
+		size <<= 20;
+	} else if (suffix == "G") {
+		size <<= 30;
+	} else if (!suffix.empty()) {
+		throw std::invalid_argument("Invalid size: " + str);
+	}
+	return size;
+}
+
+Format parse_format(const std::string& str) {
+	for (auto format : {Format::Binary, Format::Json, Format::Sqlite}) {
+		if (str == format_name(format)) {
+			return format;
+		}
+	}
+	throw std::invalid_argument("Invalid format: " + str);
+}
+
+void usage(const char* name) {
+	std::cerr << "Usage: " << name << " DIRECTORY [--count N] [--sizes SIZE,...] [--formats bin,json,sqlite] [--sparse]\n"
+	          << "       [--sqlite-template FILE]\n"
+	          << "\n"
+	          << "Create N resources of each format and body size in DIRECTORY, named <format>-<size>-<index>.<format>,\n"
+	          << "and write their metadata with set_metadata. Sizes are in bytes, with an optional K, M or G suffix.\n"
+	          << "With --sparse, the bodies of binary resources are holes, which allows sizes larger than the disk.\n"
+	          << "The sqlite resources are copies of the resource database given by --sqlite-template (by default\n"
+	          << SQLITE_TEMPLATE << ")."
+	          << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			if (arg == "--count" && i + 1 < argc) {
+				options.count = std::strtoul(argv[++i], nullptr, 10);
+			} else if (arg == "--sizes" && i + 1 < argc) {
+				options.sizes.clear();
+				for (const auto& size : split(argv[++i])) {
+					options.sizes.push_back(parse_size(size));
+				}
+			} else if (arg == "--formats" && i + 1 < argc) {
+				options.formats.clear();
+				for (const auto& format : split(argv[++i])) {
+					options.formats.push_back(parse_format(format));
+				}
+			} else if (arg == "--sparse") {
+				options.sparse = true;
+			} else if (arg == "--sqlite-template" && i + 1 < argc) {
+				options.sqlite_template = argv[++i];
+			} else if (arg[0] != '-' && options.directory.empty()) {
+				options.directory = arg;
+			} else {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+	} catch (const std::invalid_argument& e) {
+		std::cerr << e.what() << std::endl;
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (options.directory.empty()) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const auto chunk = make_chunk();
+
+	try {
+		for (auto format : options.formats) {
+			for (auto size : options.sizes) {
+				for (std::size_t index = 0; index < options.count; ++index) {
+					const std::string filename = options.directory + "/" + format_name(format) + "-" +
+					                             std::to_string(size) + "-" + std::to_string(index) + "." +
+					                             format_name(format);
+
+					switch (format) {
+						case Format::Binary: create_binary(filename, size, options.sparse, chunk); break;
+						case Format::Json: create_json(filename, size, chunk); break;
+						case Format::Sqlite: create_sqlite(filename, options.sqlite_template, size); break;
+					}
+
+					reven::metadata::set_metadata(filename.c_str(), make_metadata(format, index));
+				}
+			}
+
+			std::cout << format_name(format) << ": " << options.count * options.sizes.size() << " resources"
+			          << std::endl;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
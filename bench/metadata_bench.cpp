@@ -0,0 +1,544 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <metadata-common.h>
+#include <metadata-bin.h>
+#include <metadata-json.h>
+#include <metadata-sql.h>
+
+#include <rvnbinresource/metadata.h>
+#include <rvnjsonresource/metadata.h>
+#include <rvnsqlite/resource_database.h>
+
+#include "metadata-validate.h"
+
+#include "allocation_counter.h"
+
+using reven::metadata::CustomMetadata;
+using reven::metadata::Metadata;
+using reven::metadata::ResourceType;
+using reven::metadata::Version;
+
+namespace {
+
+enum class OutputFormat {
+	Text,
+	Json,
+	Csv,
+};
+
+struct Result {
+	std::string name;
+	std::size_t iterations;
+	double ns_per_op;
+	double allocs_per_op;
+};
+
+///
+/// Runs the benchmarks and collects their results
+/// Each benchmark is run once to warm up and count its allocations, then `repetitions` times: the median of the
+/// timed runs is kept, as it is less sensitive to the noise of the machine than the mean.
+///
+class Runner {
+public:
+	Runner(std::size_t iterations, std::string filter)
+		: iterations_(iterations)
+		, filter_(std::move(filter))
+	{
+	}
+
+	// `fn(i)` performs the i-th operation and returns a value added to the checksum, so it can't be optimized away
+	template <typename Fn>
+	void run(const std::string& name, Fn fn) {
+		run(name, iterations_, 1, fn);
+	}
+
+	// Same as above, but each call of `fn` performs `ops_per_call` operations
+	template <typename Fn>
+	void run(const std::string& name, std::size_t calls, std::size_t ops_per_call, Fn fn) {
+		if (name.find(filter_) == std::string::npos) {
+			return;
+		}
+
+		const std::size_t op_count = calls * ops_per_call;
+
+		std::size_t allocations;
+		{
+			allocation_counter counter;
+			for (std::size_t i = 0; i < calls; ++i) {
+				checksum_ += fn(i);
+			}
+			allocations = counter.count();
+		}
+
+		std::vector<double> durations;
+		for (std::size_t repetition = 0; repetition < repetitions; ++repetition) {
+			const auto start = std::chrono::steady_clock::now();
+			for (std::size_t i = 0; i < calls; ++i) {
+				checksum_ += fn(i);
+			}
+			const auto duration = std::chrono::steady_clock::now() - start;
+
+			durations.push_back(static_cast<double>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()
+			) / static_cast<double>(op_count));
+		}
+
+		std::nth_element(durations.begin(), durations.begin() + repetitions / 2, durations.end());
+		results_.push_back({
+			name, op_count, durations[repetitions / 2],
+			static_cast<double>(allocations) / static_cast<double>(op_count)
+		});
+	}
+
+	void print(OutputFormat format) const {
+		switch (format) {
+			case OutputFormat::Text:
+				for (const auto& result : results_) {
+					std::cout << std::left << std::setw(48) << result.name << std::right
+					          << std::setw(12) << std::fixed << std::setprecision(1) << result.ns_per_op << " ns/op"
+					          << std::setw(10) << std::setprecision(2) << result.allocs_per_op << " allocs/op"
+					          << std::endl;
+				}
+				// Printed so the measured loops can't be optimized away
+				std::cout << "checksum: " << checksum_ << std::endl;
+				break;
+			case OutputFormat::Json:
+				std::cout << "{\n  \"benchmarks\": [\n";
+				for (std::size_t i = 0; i < results_.size(); ++i) {
+					const auto& result = results_[i];
+					std::cout << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+					          << ", \"ns_per_op\": " << std::fixed << std::setprecision(3) << result.ns_per_op
+					          << ", \"allocs_per_op\": " << result.allocs_per_op << "}"
+					          << (i + 1 < results_.size() ? ",\n" : "\n");
+				}
+				std::cout << "  ],\n  \"checksum\": " << checksum_ << "\n}" << std::endl;
+				break;
+			case OutputFormat::Csv:
+				std::cout << "name,iterations,ns_per_op,allocs_per_op\n";
+				for (const auto& result : results_) {
+					std::cout << result.name << "," << result.iterations << "," << std::fixed << std::setprecision(3)
+					          << result.ns_per_op << "," << result.allocs_per_op << "\n";
+				}
+				std::cout << std::flush;
+				break;
+		}
+	}
+
+private:
+	static constexpr std::size_t repetitions = 5;
+
+	std::size_t iterations_;
+	std::string filter_;
+	std::size_t checksum_ = 0;
+	std::vector<Result> results_;
+};
+
+constexpr std::size_t Runner::repetitions;
+
+// Versions looking like the ones of the resources: mostly releases, some prereleases and builds
+std::vector<std::string> realistic_version_strings(std::size_t count) {
+	static const char* const prerelease_names[] = {"alpha", "beta", "rc", "dev", "prerelease", "nightly-build"};
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> percent(0, 99);
+
+	std::vector<std::string> versions;
+	versions.reserve(count);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		std::string str = std::to_string(gen() % 4) + "." + std::to_string(gen() % 20) + "." + std::to_string(gen() % 50);
+
+		if (percent(gen) < 40) {
+			str += std::string("-") + prerelease_names[gen() % 6];
+			if (percent(gen) < 50) {
+				str += "." + std::to_string(1 + gen() % 10);
+			}
+		}
+
+		if (percent(gen) < 20) {
+			str += "+build." + std::to_string(1 + gen() % 10000);
+		}
+
+		versions.push_back(std::move(str));
+	}
+
+	return versions;
+}
+
+// Layout of Version::Identifier before its storage was packed, kept as a reference point
+struct LegacyIdentifier {
+	Version::Identifier::Type type;
+	struct {
+		std::uint64_t number;
+		std::string str;
+	} value;
+
+	bool operator==(const LegacyIdentifier& id) const {
+		return id.type == type && id.value.number == value.number && id.value.str == value.str;
+	}
+
+	bool operator<(const LegacyIdentifier& id) const {
+		if (type == Version::Identifier::Type::String && id.type == Version::Identifier::Type::Number)
+			return false;
+		else if (type == Version::Identifier::Type::Number && id.type == Version::Identifier::Type::String)
+			return true;
+
+		if (type == Version::Identifier::Type::Number)
+			return value.number < id.value.number;
+		else
+			return value.str < id.value.str;
+	}
+};
+
+LegacyIdentifier to_legacy(const Version::Identifier& id) {
+	if (id.type() == Version::Identifier::Type::Number) {
+		return {Version::Identifier::Type::Number, {id.number(), ""}};
+	}
+	return {Version::Identifier::Type::String, {0, id.str().to_string()}};
+}
+
+// Version::to_string before it wrote to a buffer, kept as a reference point
+std::string stringstream_to_string(const Version& version) {
+	std::stringstream ss;
+
+	ss << version.major() << "." << version.minor() << "." << version.patch();
+
+	if (!version.prerelease().empty()) {
+		ss << "-" << Version::Identifier::to_string(version.prerelease());
+	}
+
+	if (!version.build().empty()) {
+		ss << "+" << Version::Identifier::to_string(version.build());
+	}
+
+	return ss.str();
+}
+
+// Former representation of the custom metadata, kept as a reference point
+using UnorderedCustomMetadata = std::unordered_map<std::string, std::string>;
+
+CustomMetadata make_custom_metadata(std::size_t size) {
+	std::vector<std::pair<std::string, std::string>> entries;
+	for (std::size_t i = 0; i < size; ++i) {
+		entries.emplace_back("key_" + std::to_string(i * 7919 % 1000), "a custom metadata value " + std::to_string(i));
+	}
+	return CustomMetadata(entries.begin(), entries.end());
+}
+
+Metadata make_metadata(CustomMetadata custom_metadata) {
+	return Metadata(ResourceType::KernelDescription, Version(1, 2, 3),
+	                "metadata_bench", Version::from_string("2.10.0-rc.1"), "Benchmark of the metadata library", std::move(custom_metadata),
+	                std::chrono::system_clock::time_point{std::chrono::seconds(1600000000)});
+}
+
+Version::Identifier::Type type_of(const Version::Identifier& id) {
+	return id.type();
+}
+
+Version::Identifier::Type type_of(const LegacyIdentifier& id) {
+	return id.type;
+}
+
+// Copies and sorts are reported per identifier
+template <typename Identifier>
+void bench_identifiers(Runner& runner, const std::string& name, const std::vector<Identifier>& identifiers,
+                       std::size_t iterations) {
+	if (identifiers.empty()) {
+		return;
+	}
+
+	const std::size_t sorts = std::max<std::size_t>(1, iterations / identifiers.size());
+	runner.run(name + "/copy", sorts, identifiers.size(), [&](std::size_t) {
+		auto copy = identifiers;
+		return copy.size();
+	});
+
+	runner.run(name + "/sort", sorts, identifiers.size(), [&](std::size_t) {
+		auto copy = identifiers;
+		std::sort(copy.begin(), copy.end());
+		return static_cast<std::size_t>(type_of(copy.front()) == Version::Identifier::Type::Number);
+	});
+
+	runner.run(name + "/compare", [&](std::size_t i) {
+		const auto& a = identifiers[i % identifiers.size()];
+		const auto& b = identifiers[(i + 1) % identifiers.size()];
+		return static_cast<std::size_t>(a == b) + static_cast<std::size_t>(a < b);
+	});
+}
+
+void bench_version(Runner& runner, std::size_t iterations) {
+	const auto strings = realistic_version_strings(std::min<std::size_t>(iterations, 4096));
+
+	runner.run("version/from_string/release", [](std::size_t) {
+		return Version::from_string("1.2.3").patch();
+	});
+
+	runner.run("version/from_string/prerelease_build", [](std::size_t) {
+		return Version::from_string("1.2.3-rc.1+build.4242").patch();
+	});
+
+	runner.run("version/from_string/realistic", [&](std::size_t i) {
+		return Version::from_string(strings[i % strings.size()]).patch();
+	});
+
+	std::vector<Version> versions;
+	std::vector<Version> formatted_versions;
+	for (const auto& str : strings) {
+		versions.push_back(Version::from_string(str, true));
+		const auto& version = versions.back();
+		formatted_versions.emplace_back(version.major(), version.minor(), version.patch(), version.prerelease(),
+		                                version.build());
+	}
+
+	runner.run("version/to_string/stringstream", [&](std::size_t i) {
+		return stringstream_to_string(formatted_versions[i % formatted_versions.size()]).size();
+	});
+
+	runner.run("version/to_chars", [&](std::size_t i) {
+		char buffer[64];
+		return formatted_versions[i % formatted_versions.size()].to_chars(buffer, sizeof(buffer));
+	});
+
+	runner.run("version/to_string/kept_string", [&](std::size_t i) {
+		return versions[i % versions.size()].to_string().size();
+	});
+
+	runner.run("version/to_string/formatted", [&](std::size_t i) {
+		return formatted_versions[i % formatted_versions.size()].to_string().size();
+	});
+
+	runner.run("version/compare", [&](std::size_t i) {
+		const auto& a = versions[i % versions.size()];
+		const auto& b = versions[(i + 1) % versions.size()];
+		return static_cast<std::size_t>(a.compare(b).detail);
+	});
+
+	runner.run("version/operator<", [&](std::size_t i) {
+		return static_cast<std::size_t>(versions[i % versions.size()] < versions[(i + 1) % versions.size()]);
+	});
+
+	// Copies and sorts of the whole set: reported per version
+	const std::size_t sorts = std::max<std::size_t>(1, iterations / versions.size());
+	runner.run("version/copy", sorts, versions.size(), [&](std::size_t) {
+		auto copy = versions;
+		return copy.size();
+	});
+
+	std::vector<Version> sorted;
+	runner.run("version/sort", sorts, versions.size(), [&](std::size_t) {
+		sorted = versions;
+		std::sort(sorted.begin(), sorted.end());
+		return sorted.front().major();
+	});
+
+	runner.run("version/lower_bound", [&](std::size_t i) {
+		return static_cast<std::size_t>(
+			std::lower_bound(sorted.begin(), sorted.end(), versions[i % versions.size()]) - sorted.begin()
+		);
+	});
+
+	std::vector<Version::SortKey> keys;
+	for (const auto& version : versions) {
+		keys.push_back(version.sort_key());
+	}
+
+	runner.run("version/sort_key/sort", sorts, keys.size(), [&](std::size_t) {
+		auto copy = keys;
+		std::sort(copy.begin(), copy.end());
+		return static_cast<std::size_t>(copy.front().high);
+	});
+
+	std::vector<Version::Identifier> identifiers;
+	std::vector<LegacyIdentifier> legacy_identifiers;
+	for (const auto& version : versions) {
+		for (const auto& id : version.prerelease()) {
+			identifiers.push_back(id);
+			legacy_identifiers.push_back(to_legacy(id));
+		}
+		for (const auto& id : version.build()) {
+			identifiers.push_back(id);
+			legacy_identifiers.push_back(to_legacy(id));
+		}
+	}
+
+	bench_identifiers(runner, "identifier", identifiers, iterations);
+	bench_identifiers(runner, "identifier/legacy", legacy_identifiers, iterations);
+}
+
+void bench_resource_type(Runner& runner) {
+	std::vector<ResourceType> types;
+	std::vector<std::string> names;
+	for (auto type = static_cast<std::uint32_t>(ResourceType::_MinValue);
+	     type <= static_cast<std::uint32_t>(ResourceType::_MaxValue); ++type) {
+		types.push_back(static_cast<ResourceType>(type));
+		names.push_back(reven::metadata::to_string(types.back()).to_string());
+	}
+
+	runner.run("resource_type/to_string", [&](std::size_t i) {
+		return reven::metadata::to_string(types[i % types.size()]).size();
+	});
+
+	runner.run("resource_type/to_resource_type", [&](std::size_t i) {
+		return static_cast<std::size_t>(reven::metadata::to_resource_type(names[i % names.size()]));
+	});
+}
+
+// Copies are reported per map, lookups per entry and iterations per map
+template <typename Map>
+void bench_custom_metadata_map(Runner& runner, const std::string& name,
+                               const std::vector<std::pair<std::string, std::string>>& entries) {
+	const Map map(entries.begin(), entries.end());
+
+	runner.run(name + "/copy", [&](std::size_t) {
+		Map copy = map;
+		return copy.size();
+	});
+
+	runner.run(name + "/lookup", [&](std::size_t i) {
+		return map.find(entries[i % entries.size()].first)->second.size();
+	});
+
+	runner.run(name + "/iteration", [&](std::size_t) {
+		std::size_t size = 0;
+		for (const auto& entry : map) {
+			size += entry.second.size();
+		}
+		return size;
+	});
+}
+
+void bench_custom_metadata(Runner& runner) {
+	// Resources usually carry 2 to 20 custom metadata
+	for (std::size_t size : {2, 8, 20}) {
+		std::vector<std::pair<std::string, std::string>> entries;
+		for (std::size_t i = 0; i < size; ++i) {
+			entries.emplace_back("key_" + std::to_string(i * 7919 % 1000), "value " + std::to_string(i));
+		}
+
+		const std::string suffix = "/" + std::to_string(size);
+		bench_custom_metadata_map<CustomMetadata>(runner, "custom_metadata/sorted" + suffix, entries);
+		bench_custom_metadata_map<UnorderedCustomMetadata>(runner, "custom_metadata/unordered_map" + suffix, entries);
+
+		const reven::metadata::PackedCustomMetadata packed(CustomMetadata(entries.begin(), entries.end()));
+		runner.run("custom_metadata/packed" + suffix + "/copy", [&](std::size_t) {
+			auto copy = packed;
+			return copy.size();
+		});
+	}
+
+	// Validation of a large value, such as a command line or a configuration blob
+	const std::string value(4096, 'x');
+	namespace validate = reven::metadata::validate;
+
+	runner.run("custom_metadata/validation/isprint_4096", [&](std::size_t) {
+		return static_cast<std::size_t>(
+			std::find_if(value.begin(), value.end(), [](char c) { return !std::isprint(c); }) == value.end()
+		) + static_cast<std::size_t>(std::find(value.begin(), value.end(), '.') == value.end());
+	});
+
+	runner.run("custom_metadata/validation/scalar_4096", [&](std::size_t) {
+		return validate::scan_scalar(value.data(), value.size()).first_dot;
+	});
+
+	runner.run("custom_metadata/validation/dispatched_4096", [&](std::size_t) {
+		return validate::scan(value.data(), value.size()).first_dot;
+	});
+}
+
+void bench_metadata(Runner& runner) {
+	for (std::size_t size : {0, 8, 64}) {
+		const auto custom_metadata = make_custom_metadata(size);
+
+		runner.run("metadata/construct/custom_" + std::to_string(size), [&](std::size_t) {
+			return make_metadata(custom_metadata).custom_metadata().size();
+		});
+	}
+}
+
+void bench_raw_metadata(Runner& runner) {
+	const auto md = make_metadata({});
+	const auto md_custom = make_metadata(make_custom_metadata(8));
+
+	const auto bin_md = reven::metadata::to_bin_raw_metadata(md);
+	runner.run("raw/bin/to_raw_metadata", [&](std::size_t) {
+		return reven::metadata::to_bin_raw_metadata(md).type();
+	});
+	runner.run("raw/bin/from_raw_metadata", [&](std::size_t) {
+		return reven::metadata::from_raw_metadata(bin_md).tool_name().size();
+	});
+
+	const auto json_md = reven::metadata::to_json_raw_metadata(md_custom);
+	runner.run("raw/json/to_raw_metadata/custom_8", [&](std::size_t) {
+		return reven::metadata::to_json_raw_metadata(md_custom).type();
+	});
+	runner.run("raw/json/from_raw_metadata/custom_8", [&](std::size_t) {
+		return reven::metadata::from_raw_metadata(json_md).custom_metadata().size();
+	});
+
+	const auto sql_md = reven::metadata::to_sqlite_raw_metadata(md);
+	runner.run("raw/sql/to_raw_metadata", [&](std::size_t) {
+		return reven::metadata::to_sqlite_raw_metadata(md).type();
+	});
+	runner.run("raw/sql/from_raw_metadata", [&](std::size_t) {
+		return reven::metadata::from_raw_metadata(sql_md).tool_name().size();
+	});
+}
+
+void usage(const char* name) {
+	std::cerr << "Usage: " << name << " [--format text|json|csv] [--filter SUBSTRING] [ITERATIONS]" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t iterations = 100000;
+	std::string filter;
+	OutputFormat format = OutputFormat::Text;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			const std::string value = argv[++i];
+			if (value == "text") {
+				format = OutputFormat::Text;
+			} else if (value == "json") {
+				format = OutputFormat::Json;
+			} else if (value == "csv") {
+				format = OutputFormat::Csv;
+			} else {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		} else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (argv[i][0] != '-' && std::strtoul(argv[i], nullptr, 10) > 0) {
+			iterations = std::strtoul(argv[i], nullptr, 10);
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	Runner runner(iterations, filter);
+
+	bench_version(runner, iterations);
+	bench_resource_type(runner);
+	bench_custom_metadata(runner);
+	bench_metadata(runner);
+	bench_raw_metadata(runner);
+
+	runner.print(format);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#include <boost/program_options.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <iostream>
+#include <string>
+#include <metadata-common.h>
+#include <metadata-catalog.h>
+
+namespace {
+
+constexpr const char* usage =
+	"Usage: ./metadata_catalog CATALOG update [FILE|DIRECTORY]... [OPTION]...\n"
+	"       ./metadata_catalog CATALOG query [OPTION]...";
+
+reven::metadata::Catalog::Query build_query(const boost::program_options::variables_map& vars)
+{
+	reven::metadata::Catalog::Query query;
+
+	if (vars.count("type")) {
+		query.type = reven::metadata::to_resource_type(vars["type"].as<std::string>());
+	}
+	if (vars.count("tool-name")) {
+		query.tool_name = vars["tool-name"].as<std::string>();
+	}
+	if (vars.count("tool-version-min")) {
+		query.tool_version_min = reven::metadata::Version::from_string(vars["tool-version-min"].as<std::string>());
+	}
+	if (vars.count("tool-version-max")) {
+		query.tool_version_max = reven::metadata::Version::from_string(vars["tool-version-max"].as<std::string>());
+	}
+	if (vars.count("format-version-min")) {
+		query.format_version_min = reven::metadata::Version::from_string(vars["format-version-min"].as<std::string>());
+	}
+	if (vars.count("format-version-max")) {
+		query.format_version_max = reven::metadata::Version::from_string(vars["format-version-max"].as<std::string>());
+	}
+	if (vars.count("path-prefix")) {
+		query.path_prefix = vars["path-prefix"].as<std::string>();
+	}
+	if (vars.count("custom")) {
+		for (const auto& custom : vars["custom"].as<std::vector<std::string>>()) {
+			const auto split = custom.find(":");
+			if (split == std::string::npos) {
+				throw reven::metadata::MetadataError("Wrong `custom` option format.");
+			}
+			query.custom.emplace_back(custom.substr(0, split), custom.substr(split + 1));
+		}
+	}
+
+	return query;
+}
+
+void print_entry_text(const reven::metadata::Catalog::Entry& entry)
+{
+	const auto& md = entry.metadata;
+	std::cout << entry.path << "\t" << reven::metadata::to_string(md.type()) << "\t"
+	          << md.format_version().to_string() << "\t" << md.tool_name() << "\t"
+	          << md.tool_version().to_string() << std::endl;
+}
+
+void print_entry_json(const reven::metadata::Catalog::Entry& entry)
+{
+	const auto& md = entry.metadata;
+	boost::property_tree::ptree root;
+
+	root.put("file", entry.path);
+	root.put("format-version", md.format_version().to_string());
+	root.put("type", reven::metadata::to_string(md.type()).to_string());
+	root.put("generation-date", reven::metadata::to_date_string(md.generation_date()));
+	root.put("tool-name", md.tool_name().to_string());
+	root.put("tool-version", md.tool_version().to_string());
+	root.put("tool-info", md.tool_info().to_string());
+	for (const auto& custom : md.custom_metadata()) {
+		root.put(std::string("custom.") + custom.first, custom.second);
+	}
+
+	boost::property_tree::write_json(std::cout, root, false);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		std::string catalog_file;
+		std::string command;
+		std::vector<std::string> paths;
+		std::string output_format;
+		unsigned jobs;
+
+		namespace po = boost::program_options;
+		po::options_description desc("Options description");
+		desc.add_options()
+			("help,h",
+			 "Produce help message.")
+			("catalog",
+			 po::value<std::string>(&catalog_file),
+			 "The sqlite file storing the catalog, created if needed")
+			("command",
+			 po::value<std::string>(&command),
+			 "\"update\" to scan the paths and store their metadata in the catalog, "
+			 "\"query\" to list the resources of the catalog")
+			("path",
+			 po::value<std::vector<std::string>>(&paths),
+			 "update: The files and directories to scan")
+			("jobs,j",
+			 po::value<unsigned>(&jobs)->default_value(0),
+			 "update: Number of threads reading the resources, 0 to use one thread per core")
+			("output,o",
+			 po::value<std::string>(&output_format)->default_value("text"),
+			 "query: Format of the output. Must be \"text\" or \"json\" (one object per line)")
+			("type,t",
+			 po::value<std::string>(),
+			 "query: Only resources of this type")
+			("tool-name",
+			 po::value<std::string>(),
+			 "query: Only resources generated by this tool")
+			("tool-version-min",
+			 po::value<std::string>(),
+			 "query: Only resources generated by a tool version greater or equal to this one")
+			("tool-version-max",
+			 po::value<std::string>(),
+			 "query: Only resources generated by a tool version older than this one")
+			("format-version-min",
+			 po::value<std::string>(),
+			 "query: Only resources with a format version greater or equal to this one")
+			("format-version-max",
+			 po::value<std::string>(),
+			 "query: Only resources with a format version older than this one")
+			("path-prefix",
+			 po::value<std::string>(),
+			 "query: Only resources whose path starts with this prefix")
+			("custom",
+			 po::value<std::vector<std::string>>(),
+			 "query: Only resources with this custom metadata. \n"
+			 "Can be repeated. \n"
+			 "format: \"key:value\" \n");
+
+		po::positional_options_description positional_options;
+		positional_options.add("catalog", 1);
+		positional_options.add("command", 1);
+		positional_options.add("path", -1);
+
+		po::variables_map vars;
+		try {
+			po::store(po::command_line_parser(argc, argv).options(desc).positional(positional_options).run(), vars);
+			if (vars.count("help")) {
+				std::cout << usage << std::endl;
+				std::cout << desc << std::endl;
+				return EXIT_SUCCESS;
+			}
+			po::notify(vars);
+		} catch (const boost::program_options::error& error) {
+			std::cerr << "Error: " << error.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (!vars.count("catalog") || !vars.count("command")) {
+			std::cerr << "Error: missing the catalog or the command" << std::endl;
+			std::cerr << usage << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (output_format != "text" && output_format != "json") {
+			std::cerr << "Error: cannot format the output in " << output_format << std::endl;
+			std::cerr << "Choose \"text\" or \"json\" as output" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		auto catalog = reven::metadata::Catalog::open(catalog_file.c_str());
+
+		if (command == "update") {
+			if (paths.empty()) {
+				std::cerr << "Error: missing the paths to scan" << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			const auto stats = catalog.update(paths, jobs);
+			std::cerr << stats.scanned << " files scanned, " << stats.read << " read ("
+			          << stats.not_resources << " not resources, " << stats.errors << " errors), " << stats.removed
+			          << " removed" << std::endl;
+		} else if (command == "query") {
+			for (const auto& entry : catalog.query(build_query(vars))) {
+				if (output_format == "text") {
+					print_entry_text(entry);
+				} else {
+					print_entry_json(entry);
+				}
+			}
+		} else {
+			std::cerr << "Error: unknown command " << command << std::endl;
+			std::cerr << usage << std::endl;
+			return EXIT_FAILURE;
+		}
+
+	} catch (const std::exception& error) {
+		std::cerr << "Error: " << error.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,26 +1,58 @@
 
+#include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
+#include <boost/filesystem.hpp>
+#include <atomic>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <metadata-common.h>
 #include <metadata-file.h>
+#include <metadata-stats.h>
+
+#include "resource_walker.h"
 
 using RequiredMetadata = std::vector<std::pair<std::string, std::string>>;
 using CustomMetadata = std::vector<std::pair<std::string, std::string>>;
 
-std::string from_time_point_to_string(const std::chrono::system_clock::time_point& tp)
+///
+/// Fields of the metadata selected on the command line, all of them if none is selected
+///
+reven::metadata::MetadataFields selected_fields(const boost::program_options::variables_map& vars)
 {
-	auto time = std::chrono::system_clock::to_time_t(tp);
-	char buffer[24];
-	strftime(buffer, sizeof(buffer), "%Y-%m-%dT%TZ", gmtime(&time));
-	return buffer;
+	using reven::metadata::MetadataFields;
+
+	MetadataFields fields = MetadataFields::None;
+	if (vars.count("format-version")) {
+		fields |= MetadataFields::FormatVersion;
+	}
+	if (vars.count("type")) {
+		fields |= MetadataFields::Type;
+	}
+	if (vars.count("generation-date")) {
+		fields |= MetadataFields::GenerationDate;
+	}
+	if (vars.count("tool-name")) {
+		fields |= MetadataFields::ToolName;
+	}
+	if (vars.count("tool-version")) {
+		fields |= MetadataFields::ToolVersion;
+	}
+	if (vars.count("tool-info")) {
+		fields |= MetadataFields::ToolInfo;
+	}
+	if (vars.count("custom")) {
+		fields |= MetadataFields::Custom;
+	}
+	return fields == MetadataFields::None ? MetadataFields::All : fields;
 }
 
 std::pair<RequiredMetadata, CustomMetadata> get_metadata(const boost::program_options::variables_map& vars,
-                                                         const reven::metadata::Metadata& md) {
+                                                         const reven::metadata::MetadataView& md) {
 	RequiredMetadata required_metadata {};
 	CustomMetadata custom_metadata {};
 	if (vars.count("format-version")) {
@@ -30,7 +62,7 @@ std::pair<RequiredMetadata, CustomMetadata> get_metadata(const boost::program_op
 		required_metadata.emplace_back("type", reven::metadata::to_string(md.type()).to_string());
 	}
 	if (vars.count("generation-date")) {
-		required_metadata.emplace_back("generation-date", from_time_point_to_string(md.generation_date()));
+		required_metadata.emplace_back("generation-date", reven::metadata::to_date_string(md.generation_date()));
 	}
 	if (vars.count("tool-name")) {
 		required_metadata.emplace_back("tool-name", md.tool_name().to_string());
@@ -42,39 +74,42 @@ std::pair<RequiredMetadata, CustomMetadata> get_metadata(const boost::program_op
 		required_metadata.emplace_back("tool-info", md.tool_info().to_string());
 	}
 	if (vars.count("custom")) {
-		for (const auto& custom : md.custom_metadata()) {
+		const auto md_custom_metadata = md.custom_metadata();
+		for (const auto& custom : md_custom_metadata) {
 			custom_metadata.emplace_back(custom.first, custom.second);
 		}
 	}
 	if (required_metadata.empty() and custom_metadata.empty()) {
 		required_metadata.emplace_back("format-version", md.format_version().to_string());
 		required_metadata.emplace_back("type", reven::metadata::to_string(md.type()).to_string());
-		required_metadata.emplace_back("generation-date", from_time_point_to_string(md.generation_date()));
+		required_metadata.emplace_back("generation-date", reven::metadata::to_date_string(md.generation_date()));
 		required_metadata.emplace_back("tool-name", md.tool_name().to_string());
 		required_metadata.emplace_back("tool-version", md.tool_version().to_string());
 		required_metadata.emplace_back("tool-info", md.tool_info().to_string());
-		for (const auto& custom : md.custom_metadata()) {
+		const auto md_custom_metadata = md.custom_metadata();
+		for (const auto& custom : md_custom_metadata) {
 			custom_metadata.emplace_back(custom.first, custom.second);
 		}
 	}
 	return std::make_pair(required_metadata, custom_metadata);
 }
 
-void print_metadata_text(const std::pair<RequiredMetadata, CustomMetadata>& metadata)
+void print_metadata_text(std::ostream& out, const std::pair<RequiredMetadata, CustomMetadata>& metadata)
 {
 	for (const auto& m : metadata.first) {
-		std::cout << m.first << ": " << m.second << std::endl;
+		out << m.first << ": " << m.second << std::endl;
 	}
 
 	if (not metadata.second.empty()) {
-		std::cout << "custom:" << std::endl;
+		out << "custom:" << std::endl;
 		for (const auto& m : metadata.second) {
-			std::cout << "\t" << m.first << ": " << m.second << std::endl;
+			out << "\t" << m.first << ": " << m.second << std::endl;
 		}
 	}
 }
 
-void print_metadata_json(const std::pair<RequiredMetadata, CustomMetadata>& metadata)
+void print_metadata_json(std::ostream& out, const std::pair<RequiredMetadata, CustomMetadata>& metadata,
+                         bool pretty = true)
 {
 	boost::property_tree::ptree root;
 
@@ -86,14 +121,74 @@ void print_metadata_json(const std::pair<RequiredMetadata, CustomMetadata>& meta
 		root.put(std::string("custom.") + m.first, m.second);
 	}
 
-	boost::property_tree::write_json(std::cout, root);
+	boost::property_tree::write_json(out, root, pretty);
+}
+
+///
+/// Read the metadata of every resource found in the paths, in parallel, and stream one record per resource.
+/// Files found while walking a directory that aren't resources are silently skipped, every other error is reported.
+/// Return true if no error was reported.
+///
+bool scan_resources(const std::vector<std::string>& paths, unsigned jobs, const std::string& output_format,
+                    const boost::program_options::variables_map& vars)
+{
+	std::mutex output_mutex;
+	std::atomic<bool> success{true};
+
+	const auto fields = selected_fields(vars);
+
+	auto report_error = [&](const std::string& path, const std::string& error) {
+		success = false;
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cerr << "Error: " << path << ": " << error << std::endl;
+	};
+
+	auto on_file = [&](const std::string& path, bool is_root) {
+		std::ostringstream record;
+
+		try {
+			std::pair<RequiredMetadata, CustomMetadata> metadata;
+			reven::metadata::view_resource(path.c_str(), fields, [&](const reven::metadata::MetadataView& md) {
+				metadata = get_metadata(vars, md);
+			});
+
+			if (output_format == "text") {
+				record << "file: " << path << std::endl;
+				print_metadata_text(record, metadata);
+				record << std::endl;
+			} else {
+				// JSON lines: one compact object per resource
+				metadata.first.emplace(metadata.first.begin(), "file", path);
+				print_metadata_json(record, metadata, false);
+			}
+		} catch (const reven::metadata::UnknownResourceError& error) {
+			if (is_root) {
+				report_error(path, error.what());
+			}
+			return;
+		} catch (const std::exception& error) {
+			// e.g. a resource of an unknown type or version, or a file that can't be read
+			report_error(path, error.what());
+			return;
+		}
+
+		const auto output = record.str();
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cout << output << std::flush;
+	};
+
+	ResourceWalker(jobs).walk(paths, on_file, report_error);
+
+	return success;
 }
 
 int main(int argc, char* argv[])
 {
 	try {
-		std::string file;
+		std::vector<std::string> files;
 		std::string output_format;
+		std::string stats_format;
+		unsigned jobs;
 
 		namespace po = boost::program_options;
 		po::options_description desc("Options description");
@@ -101,11 +196,20 @@ int main(int argc, char* argv[])
 			("help,h",
 			 "Produce help message.")
 			("file",
-			 po::value<std::string>(&file),
-			 "The file to read from")
+			 po::value<std::vector<std::string>>(&files),
+			 "The files to read from. Directories are scanned recursively")
 			("output,o",
 			 po::value<std::string>(&output_format)->default_value("text"),
-			 "Format of the output. Must be \"text\" or \"json\"")
+			 "Format of the output. Must be \"text\" or \"json\". "
+			 "When reading several files, \"json\" outputs one object per line")
+			("jobs,j",
+			 po::value<unsigned>(&jobs)->default_value(0),
+			 "Number of threads used to read several files, 0 to use one thread per core")
+			("stats",
+			 "Print the time spent in each stage of the reading of the metadata to stderr")
+			("stats-format",
+			 po::value<std::string>(&stats_format)->default_value("text"),
+			 "Format of the stats printed with --stats. Must be \"text\" or \"prometheus\"")
 			("format-version",
 			 "The format version of the file")
 			("type,t",
@@ -128,7 +232,7 @@ int main(int argc, char* argv[])
 		try {
 			po::store(po::command_line_parser(argc, argv).options(desc).positional(positional_options).run(), vars);
 			if (vars.count("help")) {
-				std::cout << "Usage: ./metadata_reader [FILE] [OPTION]..." << std::endl;
+				std::cout << "Usage: ./metadata_reader [FILE|DIRECTORY]... [OPTION]..." << std::endl;
 				std::cout << desc << std::endl;
 				return EXIT_SUCCESS;
 			}
@@ -140,7 +244,7 @@ int main(int argc, char* argv[])
 
 		if (!vars.count("file")) {
 			std::cerr << "Error: missing the file to read from" << std::endl;
-			std::cerr << "Usage: ./metadata_reader [FILE] [OPTION]..." << std::endl;
+			std::cerr << "Usage: ./metadata_reader [FILE|DIRECTORY]... [OPTION]..." << std::endl;
 			return EXIT_FAILURE;
 		}
 		if (output_format != "text" && output_format != "json") {
@@ -149,12 +253,28 @@ int main(int argc, char* argv[])
 			return EXIT_FAILURE;
 		}
 
-		const auto md = reven::metadata::from_resource(file.c_str());
-		const auto metadata = get_metadata(vars, md);
+		// Written to stderr on exit, so the stats don't mix with the output
+		boost::optional<reven::metadata::StatsReport> stats_report;
+		if (vars.count("stats")) {
+			stats_report.emplace(std::cerr, stats_format);
+		} else if (!vars["stats-format"].defaulted()) {
+			std::cerr << "Error: --stats-format requires --stats" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (files.size() > 1 or boost::filesystem::is_directory(files.front())) {
+			return scan_resources(files, jobs, output_format, vars) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		std::pair<RequiredMetadata, CustomMetadata> metadata;
+		reven::metadata::view_resource(files.front().c_str(), selected_fields(vars),
+		                               [&](const reven::metadata::MetadataView& md) {
+			metadata = get_metadata(vars, md);
+		});
 		if (output_format == "text") {
-			print_metadata_text(metadata);
+			print_metadata_text(std::cout, metadata);
 		} else {
-			print_metadata_json(metadata);
+			print_metadata_json(std::cout, metadata);
 		}
 
 	} catch (const std::runtime_error& error) {
@@ -0,0 +1,130 @@
+#include "resource_walker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+ResourceWalker::ResourceWalker(unsigned thread_count)
+	: thread_count_(thread_count != 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency()))
+{
+	for (unsigned i = 0; i < thread_count_; ++i) {
+		queues_.emplace_back(new Queue);
+	}
+}
+
+void ResourceWalker::walk(const std::vector<std::string>& paths, const Callback& on_file,
+                          const ErrorCallback& on_error)
+{
+	// Distribute the roots between the queues, the threads will steal from each other anyway
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+		push(i % thread_count_, {paths[i], true});
+	}
+
+	std::vector<std::thread> threads;
+	for (std::size_t id = 1; id < thread_count_; ++id) {
+		threads.emplace_back([this, id, &on_file, &on_error]() { run_worker(id, on_file, on_error); });
+	}
+
+	run_worker(0, on_file, on_error);
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void ResourceWalker::run_worker(std::size_t id, const Callback& on_file, const ErrorCallback& on_error)
+{
+	Task task;
+
+	while (pending_ != 0) {
+		if (pop(id, task) || steal(id, task)) {
+			process(id, task, on_file, on_error);
+
+			if (--pending_ == 0) {
+				std::lock_guard<std::mutex> lock(idle_mutex_);
+				idle_condition_.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing to do right now, but another thread may still push the content of a directory
+		std::unique_lock<std::mutex> lock(idle_mutex_);
+		idle_condition_.wait_for(lock, std::chrono::milliseconds(1));
+	}
+}
+
+void ResourceWalker::process(std::size_t id, const Task& task, const Callback& on_file, const ErrorCallback& on_error)
+{
+	namespace fs = boost::filesystem;
+
+	boost::system::error_code ec;
+	const fs::file_status status = task.is_root ? fs::status(task.path, ec) : fs::symlink_status(task.path, ec);
+
+	if (ec) {
+		on_error(task.path, ec.message());
+		return;
+	}
+
+	if (fs::is_regular_file(status)) {
+		on_file(task.path, task.is_root);
+	} else if (fs::is_directory(status)) {
+		fs::directory_iterator it(task.path, ec);
+		const fs::directory_iterator end;
+
+		for (; !ec && it != end; it.increment(ec)) {
+			push(id, {it->path().string(), false});
+		}
+
+		if (ec) {
+			on_error(task.path, ec.message());
+		}
+	} else if (task.is_root) {
+		on_error(task.path, "Not a regular file or a directory");
+	}
+}
+
+void ResourceWalker::push(std::size_t id, Task task)
+{
+	++pending_;
+
+	{
+		std::lock_guard<std::mutex> lock(queues_[id]->mutex);
+		queues_[id]->tasks.push_back(std::move(task));
+	}
+
+	idle_condition_.notify_one();
+}
+
+bool ResourceWalker::pop(std::size_t id, Task& task)
+{
+	auto& queue = *queues_[id];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tasks.empty()) {
+		return false;
+	}
+
+	// Depth-first on the own queue keeps the number of pending paths low
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool ResourceWalker::steal(std::size_t id, Task& task)
+{
+	for (std::size_t i = 1; i < thread_count_; ++i) {
+		auto& queue = *queues_[(id + i) % thread_count_];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty()) {
+			// Steal the oldest path, likely the biggest subtree
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+///
+/// Walk files and directory trees in parallel and call a function on each regular file found.
+/// Each thread owns a queue of pending paths: it pushes the content of the directories it lists to its own queue and
+/// steals from the other queues when its own is empty, so large trees are balanced between threads.
+///
+class ResourceWalker {
+public:
+	///
+	/// \brief Callback called for each regular file
+	/// \param path The path of the file
+	/// \param is_root true if the path has been passed to `walk` directly, false if found in a directory
+	/// \note Called concurrently from several threads, it must not throw
+	using Callback = std::function<void(const std::string& path, bool is_root)>;
+
+	///
+	/// \brief Callback called when a path can't be walked (missing file, unreadable directory, ...)
+	/// \note Called concurrently from several threads, it must not throw
+	using ErrorCallback = std::function<void(const std::string& path, const std::string& error)>;
+
+	///
+	/// \param thread_count The number of threads walking the trees, 0 to use one thread per core
+	explicit ResourceWalker(unsigned thread_count);
+
+	///
+	/// \brief walk Walk the paths, recursing into directories, and return when every file has been processed
+	/// \note Symbolic links to directories are only followed when passed directly to `walk`
+	void walk(const std::vector<std::string>& paths, const Callback& on_file, const ErrorCallback& on_error);
+
+private:
+	struct Task {
+		std::string path;
+		bool is_root;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run_worker(std::size_t id, const Callback& on_file, const ErrorCallback& on_error);
+	void process(std::size_t id, const Task& task, const Callback& on_file, const ErrorCallback& on_error);
+
+	void push(std::size_t id, Task task);
+	bool pop(std::size_t id, Task& task);
+	bool steal(std::size_t id, Task& task);
+
+	unsigned thread_count_;
+	std::vector<std::unique_ptr<Queue>> queues_;
+
+	// Number of tasks pushed but not processed yet, the walk is over when it reaches 0
+	std::atomic<std::size_t> pending_{0};
+
+	std::mutex idle_mutex_;
+	std::condition_variable idle_condition_;
+};
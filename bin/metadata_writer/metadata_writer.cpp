@@ -1,4 +1,5 @@
 
+#include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 #include <iostream>
 #include <iomanip>
@@ -6,6 +7,7 @@
 
 #include <metadata-common.h>
 #include <metadata-file.h>
+#include <metadata-stats.h>
 
 std::chrono::system_clock::time_point from_string_to_time_point(const std::string& gen_date)
 {
@@ -19,33 +21,27 @@ std::chrono::system_clock::time_point from_string_to_time_point(const std::strin
 
 
 reven::metadata::Metadata build_metadata(const boost::program_options::variables_map& vars,
-                                         const reven::metadata::Metadata& old_metadata)
+                                         reven::metadata::Metadata old_metadata)
 {
-	reven::metadata::Version format_version = old_metadata.format_version();
-	reven::metadata::ResourceType type = old_metadata.type();
-	std::chrono::system_clock::time_point gen_date = old_metadata.generation_date();
-	std::string tool_name = old_metadata.tool_name().to_string();
-	reven::metadata::Version tool_version = old_metadata.tool_version();
-	std::string tool_info = old_metadata.tool_info().to_string();
-	reven::metadata::CustomMetadata custom_metadata = old_metadata.custom_metadata();
+	reven::metadata::MetadataBuilder builder(std::move(old_metadata));
 
 	if (vars.count("format-version")) {
-		format_version = reven::metadata::Version::from_string(vars["format-version"].as<std::string>());
+		builder.format_version(reven::metadata::Version::from_string(vars["format-version"].as<std::string>()));
 	}
 	if (vars.count("type")) {
-		type = reven::metadata::to_resource_type(vars["type"].as<std::string>());
+		builder.type(reven::metadata::to_resource_type(vars["type"].as<std::string>()));
 	}
 	if (vars.count("generation-date")) {
-		gen_date = from_string_to_time_point(vars["generation-date"].as<std::string>());
+		builder.generation_date(from_string_to_time_point(vars["generation-date"].as<std::string>()));
 	}
 	if (vars.count("tool-name")) {
-		tool_name = vars["tool-name"].as<std::string>();
+		builder.tool_name(vars["tool-name"].as<std::string>());
 	}
 	if (vars.count("tool-version")) {
-		tool_version = reven::metadata::Version::from_string(vars["tool-version"].as<std::string>());
+		builder.tool_version(reven::metadata::Version::from_string(vars["tool-version"].as<std::string>()));
 	}
 	if (vars.count("tool-info")) {
-		tool_info = vars["tool-info"].as<std::string>();
+		builder.tool_info(vars["tool-info"].as<std::string>());
 	}
 	if (vars.count("custom")) {
 		for (const auto& custom : vars["custom"].as<std::vector<std::string>>()) {
@@ -53,19 +49,17 @@ reven::metadata::Metadata build_metadata(const boost::program_options::variables
 			if (split == std::string::npos) {
 				throw reven::metadata::WriteMetadataError("Wrong `custom` option format.");
 			}
-			const auto key = custom.substr(0, split);
-			const auto value = custom.substr(split + 1);
-			custom_metadata[key] = value;
+			builder.custom(custom.substr(0, split), custom.substr(split + 1));
 		}
 	}
-	return reven::metadata::Metadata(type, format_version, tool_name, tool_version,
-	                                 tool_info, custom_metadata, gen_date);
+	return builder.build();
 }
 
 int main(int argc, char* argv[])
 {
 	try {
 		std::string file;
+		std::string stats_format;
 
 		namespace po = boost::program_options;
 		po::options_description desc("Options description");
@@ -75,6 +69,11 @@ int main(int argc, char* argv[])
 			("file",
 			 po::value<std::string>(&file),
 			 "The file to read from")
+			("stats",
+			 "Print the time spent in each stage of the update of the metadata to stderr")
+			("stats-format",
+			 po::value<std::string>(&stats_format)->default_value("text"),
+			 "Format of the stats printed with --stats. Must be \"text\" or \"prometheus\"")
 			("format-version,v",
 			 po::value<std::string>(),
 			 "The format version of the file")
@@ -123,8 +122,18 @@ int main(int argc, char* argv[])
 			return EXIT_FAILURE;
 		}
 
-		auto md = reven::metadata::from_resource(file.c_str());
-		reven::metadata::set_metadata(file.c_str(), build_metadata(vars, md));
+		// Written to stderr on exit, so the stats don't mix with the output
+		boost::optional<reven::metadata::StatsReport> stats_report;
+		if (vars.count("stats")) {
+			stats_report.emplace(std::cerr, stats_format);
+		} else if (!vars["stats-format"].defaulted()) {
+			std::cerr << "Error: --stats-format requires --stats" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		reven::metadata::update_metadata(file.c_str(), [&](reven::metadata::Metadata md) {
+			return build_metadata(vars, std::move(md));
+		});
 
 	} catch (const std::runtime_error& error) {
 		std::cerr << "Error: " << error.what() << std::endl;
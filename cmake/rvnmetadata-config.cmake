@@ -6,6 +6,7 @@ find_dependency(rvnsqlite REQUIRED)
 find_dependency(rvnbinresource REQUIRED)
 find_dependency(rvnjsonresource REQUIRED)
 find_package(Boost 1.49 COMPONENTS filesystem REQUIRED)
+find_dependency(Threads REQUIRED)
 
 if(NOT TARGET rvnmetadata::common)
   include("${RVNMETADATA_CMAKE_DIR}/rvnmetadata-targets.cmake")
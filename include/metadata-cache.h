@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "metadata-common.h"
+
+namespace reven {
+namespace metadata {
+
+///
+/// Cache of the metadata of resources, keyed by the (device, inode) of the file.
+/// An entry is only used if the size and the modification time of the file haven't changed since it was read.
+/// The entries are split in shards with their own reader/writer lock: lookups never wait for each other, but the
+/// lookups of a same shard still share the cache line of its lock. A hit only reads its entry, unless the entry
+/// hasn't been used since the last eviction pass.
+/// When a shard is full, an entry that hasn't been used recently is evicted, following the clock (second chance)
+/// algorithm: it approximates the least recently used entry at a constant cost.
+/// All the methods are thread-safe.
+///
+class MetadataCache {
+public:
+	using Loader = std::function<Metadata(const char* filename)>;
+
+	///
+	/// Counters of the cache
+	///
+	struct Stats {
+		std::uint64_t hits;
+		std::uint64_t misses;
+		std::uint64_t evictions;
+		std::size_t size;
+	};
+
+public:
+	///
+	/// \param capacity The maximum number of entries of the cache
+	explicit MetadataCache(std::size_t capacity);
+
+	MetadataCache(const MetadataCache&) = delete;
+	MetadataCache& operator=(const MetadataCache&) = delete;
+
+	///
+	/// \brief get Get the metadata of a resource, calling `load` if they aren't in the cache or are outdated
+	/// The file is opened and stat'ed before calling `load`. The result is only stored if the filename still refers to
+	/// the same file, unmodified, after `load` returns.
+	/// \throws The exceptions thrown by `load`
+	Metadata get(const char* filename, const Loader& load);
+
+	///
+	/// \brief update Store the metadata just written to a resource, so the next `get` returns them
+	/// \note Does nothing if the file can't be stat'ed
+	void update(const char* filename, const Metadata& md);
+
+	///
+	/// \brief invalidate Remove the entry of a resource
+	void invalidate(const char* filename);
+
+	///
+	/// \brief clear Remove all the entries
+	void clear();
+
+	///
+	/// \brief set_capacity Change the maximum number of entries, evicting entries if needed
+	void set_capacity(std::size_t capacity);
+
+	std::size_t capacity() const { return capacity_; }
+
+	Stats stats() const;
+
+private:
+	static constexpr std::size_t shard_count = 16;
+
+	struct Key {
+		std::uint64_t device;
+		std::uint64_t inode;
+
+		bool operator==(const Key& key) const { return device == key.device && inode == key.inode; }
+	};
+
+	struct KeyHash {
+		std::size_t operator()(const Key& key) const {
+			return std::hash<std::uint64_t>()(key.inode * 31 + key.device);
+		}
+	};
+
+	// State of the file when its metadata were read
+	struct FileState {
+		Key key;
+		std::int64_t size;
+		std::int64_t mtime_sec;
+		std::int64_t mtime_nsec;
+
+		bool same_content(const FileState& state) const {
+			return size == state.size && mtime_sec == state.mtime_sec && mtime_nsec == state.mtime_nsec;
+		}
+	};
+
+	struct Entry {
+		Entry(const FileState& state, Metadata md) : state(state), md(std::move(md)) {}
+
+		FileState state;
+		const Metadata md;
+		// Set by the hits, cleared by the clock hand: the entries it finds cleared are evicted
+		std::atomic<bool> referenced{false};
+	};
+
+	struct Shard {
+		mutable std::shared_timed_mutex mutex;
+		// The entries in the order of the clock, and their index in `entries` by key
+		std::vector<std::unique_ptr<Entry>> entries;
+		std::unordered_map<Key, std::size_t, KeyHash> index;
+		std::size_t hand = 0;
+
+		std::atomic<std::uint64_t> hits{0};
+		std::atomic<std::uint64_t> misses{0};
+		std::atomic<std::uint64_t> evictions{0};
+
+		// Keep the lock of the next shard out of the cache lines of this one
+		char padding[64];
+	};
+
+	static bool stat_fd(int fd, FileState& state);
+	static bool stat_file(const char* filename, FileState& state);
+
+	Shard& shard(const Key& key) { return shards_[KeyHash()(key) % shard_count]; }
+	std::size_t shard_capacity() const;
+
+	void store(const FileState& state, const Metadata& md);
+	static void remove(Shard& shard, std::size_t position);
+	static void evict(Shard& shard, std::size_t max_size);
+
+	std::atomic<std::size_t> capacity_;
+	std::array<Shard, shard_count> shards_;
+};
+
+///
+/// \brief enable_metadata_cache Make `from_resource` use a process-wide MetadataCache, and `set_metadata` update it
+/// \param capacity The maximum number of entries of the cache
+void enable_metadata_cache(std::size_t capacity = 4096);
+
+///
+/// \brief disable_metadata_cache Stop using the process-wide cache and drop its entries
+void disable_metadata_cache();
+
+///
+/// \brief process_metadata_cache Get the process-wide cache, nullptr if it isn't enabled
+MetadataCache* process_metadata_cache();
+
+}} // namespace reven::metadata
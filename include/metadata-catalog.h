@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "metadata-common.h"
+
+struct sqlite3;
+
+namespace reven {
+namespace metadata {
+
+///
+/// Exception that occurs when the catalog database can't be opened, read or written.
+///
+class CatalogError : public MetadataError {
+public:
+	CatalogError(const char* msg) : MetadataError(msg) {}
+};
+
+///
+/// Persistent index of the metadata of all the resources found under some directories, stored in a sqlite database.
+/// The versions are split in numeric columns, so the catalog can be queried without opening the resources.
+/// A catalog instance isn't thread-safe.
+///
+class Catalog {
+public:
+	///
+	/// A resource of the catalog
+	///
+	struct Entry {
+		std::string path;
+		Metadata metadata;
+	};
+
+	///
+	/// Result of an update of the catalog
+	///
+	struct UpdateStats {
+		/// Number of files found under the roots
+		std::uint64_t scanned;
+		/// Number of files read because they are new or changed since the last update
+		std::uint64_t read;
+		/// Number of files that are not resources
+		std::uint64_t not_resources;
+		/// Number of files that couldn't be read, they are left out of the catalog until an update reads them
+		std::uint64_t errors;
+		/// Number of files removed from the catalog because they don't exist anymore
+		std::uint64_t removed;
+	};
+
+	///
+	/// Criteria of a query, unset fields match every resource
+	/// The version bounds follow the semantic versioning precedence (see Version::operator<)
+	///
+	struct Query {
+		boost::optional<ResourceType> type;
+		boost::optional<std::string> tool_name;
+		/// Only resources with a tool version >= tool_version_min
+		boost::optional<Version> tool_version_min;
+		/// Only resources with a tool version < tool_version_max
+		boost::optional<Version> tool_version_max;
+		/// Only resources with a format version >= format_version_min
+		boost::optional<Version> format_version_min;
+		/// Only resources with a format version < format_version_max
+		boost::optional<Version> format_version_max;
+		/// Only resources having all these custom metadata
+		std::vector<std::pair<std::string /* key */, std::string /* value */>> custom;
+		/// Only resources whose path starts with this prefix
+		boost::optional<std::string> path_prefix;
+	};
+
+public:
+	///
+	/// \brief open Open a catalog, creating it if it doesn't exist
+	/// \param filename The filename of the sqlite database storing the catalog
+	/// \throws CatalogError if the database can't be opened or created
+	static Catalog open(const char* filename);
+
+	Catalog(Catalog&&);
+	Catalog& operator=(Catalog&&);
+	~Catalog();
+
+	///
+	/// \brief update Scan the directories recursively and store the metadata of every resource found
+	/// Only the files whose size or modification time changed since the last update are read again. The entries of
+	/// the files that don't exist anymore under the roots are removed.
+	/// \param roots The directories (or files) to scan
+	/// \param thread_count The maximum number of threads reading the resources, 0 to use one thread per core
+	/// \throws CatalogError if the catalog can't be written
+	UpdateStats update(const std::vector<std::string>& roots, unsigned thread_count = 0);
+
+	///
+	/// \brief query Get the resources matching the query, sorted by path
+	/// \throws CatalogError if the catalog can't be read
+	std::vector<Entry> query(const Query& query) const;
+
+private:
+	struct DatabaseDeleter {
+		void operator()(sqlite3* db) const;
+	};
+
+	explicit Catalog(std::unique_ptr<sqlite3, DatabaseDeleter> db);
+
+	std::unique_ptr<sqlite3, DatabaseDeleter> db_;
+};
+
+}} // namespace reven::metadata
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <initializer_list>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include <experimental/string_view>
@@ -60,6 +64,8 @@ public:
 ///  * The `_MaxValue` **has to be** the same value than the lats element of the enum
 ///  * Each element **has to** to be sorted in ascending order
 ///  * Each element value **has to** be consecutive
+///  * Each element **has to** be registered with its name in `resource_type_names` (metadata-common.cpp)
+/// These rules are checked at compile time.
 ///
 enum class ResourceType : std::uint32_t {
 	_MinValue = 0x00000001,
@@ -80,14 +86,12 @@ enum class ResourceType : std::uint32_t {
 /// \param type the ResourceType to translate
 /// \return the std::string_view representation of the ResourceType
 /// \throw UnknownResourceError if the ResourceType is not known
-/// \note This method needs to be updated when the ResourceType enum class is updated
 std::experimental::string_view to_string(const ResourceType type);
 
 /// \brief the method translate a string (name of a resource) into a ResourceType
 /// \param type the std::string to translate
 /// \return the ResourceType corresponding to the string `resource_name`
 /// \throw UnknownResourceError if the string is not a known type name
-/// \note This method needs to be updated when the ResourceType enum class is updated
 ResourceType to_resource_type(std::experimental::string_view resource_name);
 
 ///
@@ -118,7 +122,7 @@ public:
 		///
 		/// Enum representing the type of the Identifier
 		///
-		enum class Type {
+		enum class Type : std::uint8_t {
 			Number,
 			String,
 		};
@@ -128,16 +132,61 @@ public:
 		/// \brief Identifier Construct a numeric identifier
 		/// \param number The value of the identifier
 		Identifier(std::uint64_t number)
-		 : type_(Type::Number), value_{number, ""} {}
+		 : size_(0), type_(Type::Number) { storage_.number = number; }
 
 		///
 		/// \brief Identifier Construct an alphanumeric identifier
 		/// \param str The value of the identifier
-		Identifier(std::string str)
-		 : type_(Type::String), value_{0, std::move(str)} {}
+		Identifier(const std::string& str)
+		 : size_(0), type_(Type::String) { assign(str.data(), str.size()); }
+
+		Identifier(const Identifier& id)
+		 : size_(id.size_), type_(id.type_) {
+			if (id.is_heap_string()) {
+				size_ = 0;
+				assign(id.storage_.heap, id.size_);
+			} else {
+				storage_ = id.storage_;
+			}
+		}
+
+		Identifier(Identifier&& id) noexcept
+		 : storage_(id.storage_), size_(id.size_), type_(id.type_) {
+			// The moved-from identifier becomes an empty alphanumeric identifier
+			id.size_ = 0;
+			id.type_ = Type::String;
+		}
+
+		Identifier& operator=(const Identifier& id) {
+			if (this != &id) {
+				Identifier copy(id);
+				*this = std::move(copy);
+			}
+			return *this;
+		}
+
+		Identifier& operator=(Identifier&& id) noexcept {
+			if (this != &id) {
+				release();
+				storage_ = id.storage_;
+				size_ = id.size_;
+				type_ = id.type_;
+				id.size_ = 0;
+				id.type_ = Type::String;
+			}
+			return *this;
+		}
+
+		~Identifier() { release(); }
 
 		bool operator==(const Identifier& id) const {
-			return id.type_ == type_ && id.value_.number == value_.number && id.value_.str == value_.str ;
+			if (id.type_ != type_)
+				return false;
+
+			if (type_ == Type::Number)
+				return id.storage_.number == storage_.number;
+
+			return id.size_ == size_ && std::memcmp(id.data(), data(), size_) == 0;
 		}
 
 		bool operator!=(const Identifier& id) const {
@@ -145,25 +194,23 @@ public:
 		}
 
 		bool operator<(const Identifier& id) const {
-			if (type_ == Type::String && id.type_ == Type::Number)
-				return false;
-			else if (type_ == Type::Number && id.type_ == Type::String)
-				return true;
+			if (type_ != id.type_)
+				return type_ == Type::Number;
 
 			if (type_ == Type::Number)
-				return value_.number < id.value_.number;
-			else
-				return value_.str < id.value_.str;
+				return storage_.number < id.storage_.number;
+
+			return str() < id.str();
 		}
 
 		///
 		/// \brief to_string Stringify the identifier
 		std::string to_string() const {
 			if (type_ == Version::Identifier::Type::Number) {
-				return std::to_string(value_.number);
+				return std::to_string(storage_.number);
 			}
 
-			return value_.str;
+			return std::string(data(), size_);
 		}
 
 		///
@@ -173,20 +220,41 @@ public:
 		///
 		/// \brief number get the numeric value of the identifier if it's a numeric one
 		///   it's a undefined behaviour if the Identifier isn't a numeric one
-		std::uint64_t number() const { assert(type_ == Type::Number); return value_.number; }
+		std::uint64_t number() const { assert(type_ == Type::Number); return storage_.number; }
 
 		///
 		/// \brief str get the numeric value of the identifier if it's an alphanumeric one
 		///   it's a undefined behaviour if the Identifier isn't an alphanumeric one
-		std::experimental::string_view str() const { assert(type_ == Type::String); return value_.str; }
+		std::experimental::string_view str() const {
+			assert(type_ == Type::String);
+			return std::experimental::string_view(data(), size_);
+		}
 
 	private:
-		// TODO: Replace it by a std::variant in C++17
-		Type type_;
-		struct {
+		/// Alphanumeric identifiers up to this size are stored inline, without any allocation
+		static constexpr std::size_t inline_capacity = 16;
+
+		bool is_heap_string() const { return type_ == Type::String && size_ > inline_capacity; }
+
+		const char* data() const { return is_heap_string() ? storage_.heap : storage_.chars; }
+
+		// Set the alphanumeric value. The identifier must not own a heap string.
+		void assign(const char* str, std::size_t size);
+
+		void release() {
+			if (is_heap_string()) {
+				delete[] storage_.heap;
+			}
+		}
+
+		// Numeric identifiers and short alphanumeric ones only hold plain bytes, and are copied as such.
+		union Storage {
 			std::uint64_t number;
-			std::string str;
-		} value_;
+			char chars[inline_capacity];
+			char* heap;
+		} storage_;
+		std::uint32_t size_;
+		Type type_;
 	};
 
 	///
@@ -212,13 +280,34 @@ public:
 		} detail;
 	};
 
+	///
+	/// Order-preserving summary of a version, computed at construction: if a.sort_key() < b.sort_key() then a < b.
+	/// Major, minor and patch are saturated to 32 bits, and the prerelease is summarized by its first identifier.
+	/// When two keys are equal and not exact, the versions must be compared in full.
+	///
+	struct SortKey {
+		/// major (32 bits) | minor (32 bits)
+		std::uint64_t high;
+		/// patch (32 bits) | prerelease summary (31 bits) | exact (1 bit)
+		std::uint64_t low;
+
+		/// If the key represents the version without any loss, ignoring the build identifiers
+		bool is_exact() const { return (low & 1) != 0; }
+
+		bool operator==(const SortKey& key) const { return high == key.high && low == key.low; }
+		bool operator!=(const SortKey& key) const { return !(*this == key); }
+		bool operator<(const SortKey& key) const { return high < key.high || (high == key.high && low < key.low); }
+	};
+
 public:
 	///
 	/// \brief from_string Take string containing a semantic version 2.0.0 and create a Version instance
 	/// \param str The string containing the version
+	/// \param keep_string Keep a copy of `str`, which is the canonical form of the version, so that to_string and
+	///   to_chars don't have to format the version again. Only worth it if the version is formatted again.
 	/// \throws MetadataError if the version is ill-formed
 	/// \throws std::out_of_range if a numerical identifier doesn't fit in a std::uint64_t
-	static Version from_string(const std::string& str);
+	static Version from_string(std::experimental::string_view str, bool keep_string = false);
 
 public:
 	///
@@ -231,9 +320,15 @@ public:
 	Version(std::uint64_t major, std::uint64_t minor = 0, std::uint64_t patch = 0,
 		std::vector<Identifier> prerelease = {}, std::vector<Identifier> build = {})
 	 : version_numbers_{{major, minor, patch}},
-	   prerelease_{std::move(prerelease)}, build_{std::move(build)} {}
+	   prerelease_{std::move(prerelease)}, build_{std::move(build)},
+	   sort_key_(make_sort_key(version_numbers_, prerelease_)) {}
 
 	bool operator==(const Version& v) const {
+		if (v.sort_key_ != sort_key_)
+			return false;
+		if (sort_key_.is_exact())
+			return true;
+
 		return v.version_numbers_ == version_numbers_ && v.prerelease_ == prerelease_;
 	}
 
@@ -242,6 +337,11 @@ public:
 	}
 
 	bool operator<(const Version& v) const {
+		if (sort_key_ != v.sort_key_)
+			return sort_key_ < v.sort_key_;
+		if (sort_key_.is_exact())
+			return false;
+
 		if (version_numbers_ < v.version_numbers_)
 			return true;
 		else if (version_numbers_ > v.version_numbers_)
@@ -303,6 +403,14 @@ public:
 	/// \brief to_string Stringify the version
 	std::string to_string() const;
 
+	///
+	/// \brief to_chars Stringify the version in a caller-provided buffer, without any allocation
+	/// \param buffer The buffer to write to. The string isn't null-terminated
+	/// \param size The size of the buffer
+	/// \return The size of the whole string: if it is greater than `size`, only the first `size` characters
+	///   were written
+	std::size_t to_chars(char* buffer, std::size_t size) const;
+
 	///
 	/// \brief major get the major of this version
 	std::uint64_t major() const { return version_numbers_[0]; }
@@ -323,13 +431,190 @@ public:
 	/// \brief build get the build identifiers of this version
 	const std::vector<Identifier>& build() const { return build_; }
 
+	///
+	/// \brief sort_key get the order-preserving key of this version, to sort or bucket versions with integer compares
+	const SortKey& sort_key() const { return sort_key_; }
+
 private:
+	static SortKey make_sort_key(const std::array<std::uint64_t, 3>& version_numbers,
+	                             const std::vector<Identifier>& prerelease);
+
 	std::array<std::uint64_t, 3> version_numbers_;
 	std::vector<Identifier> prerelease_;
 	std::vector<Identifier> build_;
+	SortKey sort_key_;
+	// The string the version was parsed from, empty if it wasn't kept
+	std::string string_;
 };
 
-using CustomMetadata = std::unordered_map<std::string /* key */, std::string /* value */>;
+///
+/// Custom information associated to a resource: string values indexed by string keys.
+/// The entries are stored sorted by key in a single vector: lookups are binary searches, a copy only allocates the
+/// vector and the strings too long for the small string optimization, and the iteration order is deterministic.
+/// The keys can't be modified through the iterators, use `operator[]` or `insert_or_assign` to change a value.
+/// See PackedCustomMetadata for a read-only copy that stores all the keys and values in a single buffer.
+///
+class CustomMetadata {
+public:
+	using key_type = std::string;
+	using mapped_type = std::string;
+	using value_type = std::pair<std::string /* key */, std::string /* value */>;
+	using size_type = std::size_t;
+	using const_iterator = std::vector<value_type>::const_iterator;
+	using iterator = const_iterator;
+
+public:
+	CustomMetadata() = default;
+
+	///
+	/// \brief CustomMetadata Construct from a list of entries. For duplicated keys, only the first entry is kept.
+	CustomMetadata(std::initializer_list<value_type> entries)
+	 : entries_(entries) { sort_entries(); }
+
+	///
+	/// \brief CustomMetadata Construct from a range of (key, value) pairs, such as another map.
+	///   For duplicated keys, only the first entry is kept.
+	template <typename InputIt>
+	CustomMetadata(InputIt first, InputIt last)
+	 : entries_(first, last) { sort_entries(); }
+
+	///
+	/// \brief CustomMetadata Conversion from the former representation of the custom metadata
+	explicit CustomMetadata(const std::unordered_map<std::string, std::string>& map)
+	 : CustomMetadata(map.begin(), map.end()) {}
+
+	///
+	/// \brief Conversion to the former representation of the custom metadata
+	explicit operator std::unordered_map<std::string, std::string>() const {
+		return std::unordered_map<std::string, std::string>(entries_.begin(), entries_.end());
+	}
+
+	const_iterator begin() const { return entries_.begin(); }
+	const_iterator end() const { return entries_.end(); }
+	const_iterator cbegin() const { return entries_.cbegin(); }
+	const_iterator cend() const { return entries_.cend(); }
+
+	bool empty() const { return entries_.empty(); }
+	size_type size() const { return entries_.size(); }
+	void reserve(size_type size) { entries_.reserve(size); }
+	void clear() { entries_.clear(); }
+
+	const_iterator find(std::experimental::string_view key) const {
+		const auto it = lower_bound(key);
+		if (it == entries_.end() || std::experimental::string_view(it->first) != key) {
+			return entries_.end();
+		}
+		return it;
+	}
+
+	size_type count(std::experimental::string_view key) const { return find(key) != end() ? 1 : 0; }
+
+	///
+	/// \throws std::out_of_range if the key doesn't exist
+	const std::string& at(std::experimental::string_view key) const;
+
+	///
+	/// \brief operator[] Get the value of a key, inserting an empty value if the key doesn't exist
+	std::string& operator[](std::string key);
+
+	///
+	/// \brief emplace Insert an entry if the key doesn't exist yet
+	/// \return The entry with this key and whether it was inserted
+	std::pair<const_iterator, bool> emplace(std::string key, std::string value);
+	std::pair<const_iterator, bool> insert(value_type entry) {
+		return emplace(std::move(entry.first), std::move(entry.second));
+	}
+
+	///
+	/// \brief insert_or_assign Insert an entry, or replace the value if the key already exists
+	/// \return The entry with this key and whether it was inserted
+	std::pair<const_iterator, bool> insert_or_assign(std::string key, std::string value);
+
+	size_type erase(std::experimental::string_view key);
+	const_iterator erase(const_iterator it) { return entries_.erase(it); }
+
+	bool operator==(const CustomMetadata& custom_metadata) const { return entries_ == custom_metadata.entries_; }
+	bool operator!=(const CustomMetadata& custom_metadata) const { return !(*this == custom_metadata); }
+
+private:
+	void sort_entries();
+
+	const_iterator lower_bound(std::experimental::string_view key) const {
+		return std::lower_bound(entries_.begin(), entries_.end(), key,
+		                        [](const value_type& entry, std::experimental::string_view key) {
+			return std::experimental::string_view(entry.first) < key;
+		});
+	}
+
+	std::vector<value_type>::iterator lower_bound(std::experimental::string_view key) {
+		return entries_.begin() + (static_cast<const CustomMetadata&>(*this).lower_bound(key) - entries_.cbegin());
+	}
+
+	std::vector<value_type> entries_;
+};
+
+///
+/// Read-only copy of custom metadata whose keys and values are stored in a single buffer, so that a copy costs two
+/// allocations whatever the number and the size of the entries. Worth it to keep many metadata around.
+/// The entries are (key, value) views into the buffer, sorted by key like in CustomMetadata.
+///
+class PackedCustomMetadata {
+public:
+	using value_type = std::pair<std::experimental::string_view /* key */, std::experimental::string_view /* value */>;
+	using size_type = std::size_t;
+	using const_iterator = std::vector<value_type>::const_iterator;
+	using iterator = const_iterator;
+
+public:
+	PackedCustomMetadata() = default;
+
+	explicit PackedCustomMetadata(const CustomMetadata& custom_metadata);
+
+	PackedCustomMetadata(const PackedCustomMetadata& custom_metadata);
+	PackedCustomMetadata& operator=(const PackedCustomMetadata& custom_metadata);
+	// Moving the buffer doesn't move its content, the views stay valid
+	PackedCustomMetadata(PackedCustomMetadata&&) = default;
+	PackedCustomMetadata& operator=(PackedCustomMetadata&&) = default;
+
+	///
+	/// \brief Conversion to a modifiable copy
+	explicit operator CustomMetadata() const {
+		return CustomMetadata(entries_.begin(), entries_.end());
+	}
+
+	const_iterator begin() const { return entries_.begin(); }
+	const_iterator end() const { return entries_.end(); }
+	const_iterator cbegin() const { return entries_.cbegin(); }
+	const_iterator cend() const { return entries_.cend(); }
+
+	bool empty() const { return entries_.empty(); }
+	size_type size() const { return entries_.size(); }
+
+	const_iterator find(std::experimental::string_view key) const {
+		const auto it = std::lower_bound(entries_.begin(), entries_.end(), key,
+		                                 [](const value_type& entry, std::experimental::string_view key) {
+			return entry.first < key;
+		});
+		if (it == entries_.end() || it->first != key) {
+			return entries_.end();
+		}
+		return it;
+	}
+
+	size_type count(std::experimental::string_view key) const { return find(key) != end() ? 1 : 0; }
+
+	///
+	/// \throws std::out_of_range if the key doesn't exist
+	std::experimental::string_view at(std::experimental::string_view key) const;
+
+	bool operator==(const PackedCustomMetadata& custom_metadata) const { return entries_ == custom_metadata.entries_; }
+	bool operator!=(const PackedCustomMetadata& custom_metadata) const { return !(*this == custom_metadata); }
+
+private:
+	// Keys and values, one after the other
+	std::vector<char> buffer_;
+	std::vector<value_type> entries_;
+};
 
 class Metadata {
 public:
@@ -356,11 +641,11 @@ public:
 	/// \param tool_name The name of the tool used to generate this resource
 	/// \param tool_version The version of the tool used to generate this resource
 	/// \param tool_info Other information about the tool used to generate this resource
-	/// \param custom_metadata Custom information associated to this resource
+	/// \param custom_metadata Custom information associated to this resource, moved in if it is an rvalue
 	/// \param generation_date A point in time representing the date of the generation
 	/// \throws MetadataError if the resource type is unknown or custom metadata not printable
 	Metadata(ResourceType type, Version format_version,
-	         std::string tool_name, Version tool_version, std::string tool_info, const CustomMetadata& custom_metadata,
+	         std::string tool_name, Version tool_version, std::string tool_info, CustomMetadata custom_metadata,
 	         std::chrono::system_clock::time_point generation_date = std::chrono::system_clock::now());
 
 	///
@@ -390,6 +675,8 @@ public:
 	const CustomMetadata& custom_metadata() const { return custom_metadata_; }
 
 private:
+	friend class MetadataBuilder;
+
 	ResourceType type_;
 	Version format_version_;
 
@@ -402,4 +689,48 @@ private:
 	CustomMetadata custom_metadata_;
 };
 
+///
+/// Modify some fields of an existing Metadata instance.
+/// The instance is moved through the builder, so only the modified fields cost allocations:
+///   auto md = MetadataBuilder(std::move(old_md)).tool_name("my_tool").custom("key", "value").build();
+/// Each setter checks its field the way the Metadata constructor does.
+///
+class MetadataBuilder {
+public:
+	///
+	/// \brief MetadataBuilder Start from an existing instance, pass an rvalue to avoid copying it
+	explicit MetadataBuilder(Metadata md) : md_(std::move(md)) {}
+
+	///
+	/// \throws UnknownMetadataTypeError if the resource type is unknown
+	MetadataBuilder& type(ResourceType type);
+	MetadataBuilder& format_version(Version format_version);
+	MetadataBuilder& tool_name(std::string tool_name);
+	MetadataBuilder& tool_version(Version tool_version);
+	MetadataBuilder& tool_info(std::string tool_info);
+	MetadataBuilder& generation_date(std::chrono::system_clock::time_point generation_date);
+
+	///
+	/// \brief custom Add a custom metadata, or replace the value of an existing one
+	/// \throws MetadataError if the key or the value isn't valid
+	MetadataBuilder& custom(std::string key, std::string value);
+
+	///
+	/// \brief custom_metadata Replace all the custom metadata
+	/// \throws MetadataError if a key or a value isn't valid
+	MetadataBuilder& custom_metadata(CustomMetadata custom_metadata);
+
+	///
+	/// \brief build Get the resulting instance. The builder must not be used afterwards.
+	Metadata build() { return std::move(md_); }
+
+private:
+	Metadata md_;
+};
+
+///
+/// \brief to_date_string Format a generation date as an ISO 8601 date in UTC, e.g. "2019-04-02T13:45:02Z"
+/// A date that can't be formatted that way is given as its number of seconds since the epoch.
+std::string to_date_string(std::chrono::system_clock::time_point date);
+
 }} // namespace reven::metadata
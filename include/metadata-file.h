@@ -1,9 +1,48 @@
 #pragma once
 
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
 #include "metadata-common.h"
+#include "metadata-view.h"
 
 namespace reven {
 namespace metadata {
+	///
+	/// Result of reading the metadata of one resource in a batch: either its metadata or the error that occurred
+	///
+	class ResourceMetadataResult {
+	public:
+		explicit ResourceMetadataResult(Metadata md) : metadata_(std::move(md)) {}
+		explicit ResourceMetadataResult(std::exception_ptr error) : error_(std::move(error)) {}
+
+		///
+		/// \brief has_metadata true if the metadata of the resource have been read successfully
+		bool has_metadata() const { return static_cast<bool>(metadata_); }
+
+		///
+		/// \brief metadata get the metadata of the resource
+		/// \throws the exception that occurred when reading the resource if there is no metadata
+		const Metadata& metadata() const {
+			if (!metadata_) {
+				std::rethrow_exception(error_);
+			}
+			return *metadata_;
+		}
+
+		///
+		/// \brief error get the exception that occurred when reading the resource, nullptr if there is none
+		std::exception_ptr error() const { return error_; }
+
+	private:
+		boost::optional<Metadata> metadata_;
+		std::exception_ptr error_;
+	};
+
 	/// \brief from_resource Construct a metadata from a resource file pointed by the filename
 	/// \param filename The filename of the resource to open
 	/// \throws UnknownResourceError if we can't determine how to open this resource
@@ -11,6 +50,36 @@ namespace metadata {
 	/// \throws std::out_of_range if a numerical identifier in the version doesn't fit in a std::uint64_t
 	Metadata from_resource(const char* filename);
 
+	/// \brief view_resource Read the metadata of a resource and pass a view over them to a visitor
+	/// Only the fields accessed by the visitor are parsed and copied, so e.g. filtering resources by type costs little
+	/// more than opening them. Unlike `from_resource`, doesn't use the metadata cache.
+	/// \param filename The filename of the resource to open
+	/// \param visitor Called once with the view, which is only valid during the call
+	/// \throws UnknownResourceError if we can't determine how to open this resource
+	/// \throws ReadMetadataError if there is an error when or after opening the resource
+	void view_resource(const char* filename, const std::function<void(const MetadataView&)>& visitor);
+
+	/// \brief view_resource Read only some fields of the metadata of a resource and pass a view over them to a visitor
+	/// Depending on the format of the resource, the fields that are not requested may not be read at all, e.g. only the
+	/// first bytes of a binary resource are read for its type, only the type column of a sqlite resource is selected,
+	/// and the custom metadata of a JSON resource are skipped when not requested. The view may contain more fields
+	/// than requested, accessing one it does not contain throws std::logic_error.
+	/// \param filename The filename of the resource to open
+	/// \param fields The fields the visitor needs
+	/// \param visitor Called once with the view, which is only valid during the call
+	/// \throws UnknownResourceError if we can't determine how to open this resource
+	/// \throws ReadMetadataError if there is an error when or after opening the resource
+	void view_resource(const char* filename, MetadataFields fields,
+	                   const std::function<void(const MetadataView&)>& visitor);
+
+	/// \brief from_resources Read the metadata of several resources in parallel
+	/// \param filenames The filenames of the resources to open
+	/// \param thread_count The maximum number of threads reading the resources, 0 to use one thread per core
+	/// \return One result per filename, in the same order. A resource that can't be read doesn't stop the others,
+	///   the exception that `from_resource` would have thrown is stored in its result instead.
+	std::vector<ResourceMetadataResult> from_resources(const std::vector<std::string>& filenames,
+	                                                   unsigned thread_count = 0);
+
     /// \brief set_metadata Set the metadata of a resource pointed by the filename
 	/// \note The resource must already have metadata
 	/// \param filename The filename of the resource to write to
@@ -19,4 +88,20 @@ namespace metadata {
 	/// \throws WriteMetadataError if there is an error when or after opening the resource, e.g if the resource
 	///   doesn't have metadata
 	void set_metadata(const char* filename, const Metadata& md);
+
+	/// \brief update_metadata Modify the metadata of a resource pointed by the filename
+	/// Unlike `from_resource` followed by `set_metadata`, the format of the resource is only detected once. A sqlite
+	/// resource is read and written through a single connection. The writers of the binary and JSON formats can't read
+	/// the metadata, so these resources are read before being opened for writing: a concurrent write in between is
+	/// not detected. The errors are the same for every format: the ones of `from_resource` while reading, then the
+	/// ones of `set_metadata` while writing.
+	/// \param filename The filename of the resource to modify
+	/// \param fn Called with the current metadata of the resource, returns the metadata to write in it
+	/// \throws UnknownResourceError if we can't determine how to open this resource
+	/// \throws ReadMetadataError if the current metadata can't be read, e.g. if the resource doesn't have metadata
+	/// \throws MetadataError if the current metadata are ill-formed, e.g. UnknownMetadataTypeError for an unknown type
+	/// \throws WriteMetadataError if the resource can't be opened for writing or the metadata can't be written in it,
+	///   e.g. if its metadata are outdated
+	/// \throws the exceptions thrown by `fn`, in which case the resource is not modified
+	void update_metadata(const char* filename, const std::function<Metadata(Metadata)>& fn);
 }} // namespace reven::metadata
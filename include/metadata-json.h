@@ -1,6 +1,7 @@
 #pragma once
 
 #include "metadata-common.h"
+#include "metadata-view.h"
 
 namespace reven {
 
@@ -15,6 +16,10 @@ namespace metadata {
 	/// \throws std::out_of_range if a numerical identifier in the version doesn't fit in a std::uint64_t
 	Metadata from_raw_metadata(const reven::jsonresource::Metadata& md);
 
+	/// \brief view_raw_metadata Construct a view borrowing the fields of a raw metadata, without parsing them
+	/// \param md The raw metadata, which must outlive the view
+	MetadataView view_raw_metadata(const reven::jsonresource::Metadata& md);
+
 	/// \brief to_json_raw_metadata Construct a raw json metadata from the information stored in this metadata
 	reven::jsonresource::Metadata to_json_raw_metadata(const Metadata& md);
 }} // namespace reven::metadata
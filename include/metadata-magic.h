@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "metadata-common.h"
+
+namespace reven {
+namespace metadata {
+
+///
+/// Process-wide mime type detector based on libmagic.
+/// Each thread using the detector lazily gets its own magic cookie, loaded with the default magic database, because a
+/// cookie can't be shared between threads. The cookies are kept until the threads exit.
+/// All the methods are thread-safe.
+///
+class MagicDetector {
+public:
+	///
+	/// Timing information about the detector, to measure the cost of the format detection
+	///
+	struct Stats {
+		/// Number of magic cookies opened (one per thread that used the detector)
+		std::uint64_t cookie_count;
+		/// Total time spent opening and loading the magic cookies
+		std::chrono::nanoseconds cookie_load_time;
+		/// Number of calls to mime_type
+		std::uint64_t detection_count;
+		/// Total time spent in mime_type, excluding the cookie loading
+		std::chrono::nanoseconds detection_time;
+	};
+
+public:
+	///
+	/// \brief instance Get the process-wide detector, loading the magic database of the calling thread on the first call
+	/// \throws ReadMetadataError if the magic database can't be loaded
+	static MagicDetector& instance();
+
+	MagicDetector(const MagicDetector&) = delete;
+	MagicDetector& operator=(const MagicDetector&) = delete;
+
+	///
+	/// \brief mime_type Detect the mime type of a file
+	/// \param filename The filename of the file to detect, symlinks are followed
+	/// \throws ReadMetadataError if libmagic can't be initialized for this thread or fails to detect the type
+	std::string mime_type(const char* filename);
+
+	///
+	/// \brief stats Get the timing information accumulated since the creation of the detector
+	Stats stats() const;
+
+private:
+	MagicDetector();
+
+	struct Cookie;
+
+	Cookie& thread_cookie();
+	void load_cookie(Cookie& cookie);
+
+	std::atomic<std::uint64_t> cookie_count_{0};
+	std::atomic<std::uint64_t> cookie_load_time_{0};
+	std::atomic<std::uint64_t> detection_count_{0};
+	std::atomic<std::uint64_t> detection_time_{0};
+};
+
+}} // namespace reven::metadata
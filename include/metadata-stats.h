@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <experimental/string_view>
+#include <ostream>
+
+#include "metadata-common.h"
+
+namespace reven {
+namespace metadata {
+
+///
+/// Stages of reading and writing the metadata of a resource
+///
+enum class Stage : std::uint8_t {
+	/// Identifying the format of the resource, from its first bytes or with libmagic
+	Detect,
+	/// Opening the resource with the library of its format, to write it or when it can't be read directly
+	Open,
+	/// Getting the raw metadata of the resource. When they are read directly, this includes opening it.
+	ReadRaw,
+	/// Converting between raw metadata and Metadata, including the version parsing and the validate stage
+	Convert,
+	/// Checking that the custom metadata are printable
+	Validate,
+	/// Writing the raw metadata to the resource
+	Write,
+};
+
+constexpr std::size_t stage_count = 6;
+
+///
+/// \brief to_string Get the name of a stage, e.g. "read_raw"
+std::experimental::string_view to_string(Stage stage);
+
+///
+/// Number of calls and latency histogram of a stage
+///
+struct StageStats {
+	/// Number of buckets of the histogram, the last one counting the calls longer than the others' bounds
+	static constexpr std::size_t bucket_count = 12;
+
+	///
+	/// \brief bucket_bound Get the exclusive upper bound of a bucket: 1us for the first one, 4 times the previous one
+	///   for the next ones, and nanoseconds::max() for the last one
+	static std::chrono::nanoseconds bucket_bound(std::size_t bucket);
+
+	std::uint64_t count = 0;
+	std::chrono::nanoseconds total_time{0};
+	/// Number of calls per bucket, not cumulative
+	std::array<std::uint64_t, bucket_count> buckets{};
+};
+
+///
+/// Snapshot of the process-wide instrumentation
+///
+struct MetadataStats {
+	std::array<StageStats, stage_count> stages;
+	/// Number of reads for which the fast path of the format couldn't be used, falling back to its library
+	std::uint64_t fallbacks = 0;
+
+	const StageStats& operator[](Stage stage) const { return stages[static_cast<std::size_t>(stage)]; }
+};
+
+///
+/// \brief enable_metadata_stats Start recording the count and the latency of each stage, in every thread
+/// When disabled, which is the default, the instrumentation costs a relaxed atomic load per stage.
+void enable_metadata_stats();
+
+///
+/// \brief disable_metadata_stats Stop recording, keeping what has been recorded
+void disable_metadata_stats();
+
+///
+/// \brief metadata_stats_enabled true if the stages are being recorded
+bool metadata_stats_enabled();
+
+///
+/// \brief metadata_stats Get what has been recorded since the start of the process or the last reset
+/// The counters are read one by one while they may be updated, so the snapshot is not atomic.
+MetadataStats metadata_stats();
+
+///
+/// \brief reset_metadata_stats Set all the counters back to 0
+void reset_metadata_stats();
+
+///
+/// \brief write_stats_text Write the stats as a human-readable table
+void write_stats_text(std::ostream& out, const MetadataStats& stats);
+
+///
+/// \brief write_stats_prometheus Write the stats in the Prometheus text exposition format
+/// The stages are exported as the `rvnmetadata_stage_duration_seconds` histogram, labelled by stage, and the
+/// fallbacks as the `rvnmetadata_read_fallbacks_total` counter.
+void write_stats_prometheus(std::ostream& out, const MetadataStats& stats);
+
+///
+/// \brief write_stats Write the stats in `format`: "text" for write_stats_text, "prometheus" for
+///   write_stats_prometheus
+/// \throws MetadataError if the format is unknown
+void write_stats(std::ostream& out, const MetadataStats& stats, std::experimental::string_view format);
+
+///
+/// Enable the stats during its lifetime, and write them on destruction, e.g. at the end of a program whatever the
+/// way it exits
+///
+class StatsReport {
+public:
+	///
+	/// \brief StatsReport Enable the stats, to be written to `out` in `format`, as for write_stats
+	/// \throws MetadataError if the format is unknown, without enabling the stats
+	StatsReport(std::ostream& out, std::experimental::string_view format);
+
+	~StatsReport();
+
+	StatsReport(const StatsReport&) = delete;
+	StatsReport& operator=(const StatsReport&) = delete;
+
+private:
+	std::ostream& out_;
+	std::experimental::string_view format_;
+};
+
+}} // namespace reven::metadata
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <experimental/string_view>
+#include <stdexcept>
+
+#include <boost/optional.hpp>
+
+#include "metadata-common.h"
+
+namespace reven {
+namespace metadata {
+
+///
+/// Mask of metadata fields, used to only read the fields that are needed
+///
+enum class MetadataFields : std::uint8_t {
+	None = 0,
+	Type = 1 << 0,
+	FormatVersion = 1 << 1,
+	ToolName = 1 << 2,
+	ToolVersion = 1 << 3,
+	ToolInfo = 1 << 4,
+	GenerationDate = 1 << 5,
+	Custom = 1 << 6,
+	All = (1 << 7) - 1,
+};
+
+constexpr MetadataFields operator|(MetadataFields a, MetadataFields b) {
+	return static_cast<MetadataFields>(static_cast<std::uint8_t>(a) | static_cast<std::uint8_t>(b));
+}
+
+constexpr MetadataFields operator&(MetadataFields a, MetadataFields b) {
+	return static_cast<MetadataFields>(static_cast<std::uint8_t>(a) & static_cast<std::uint8_t>(b));
+}
+
+constexpr MetadataFields operator~(MetadataFields a) {
+	return static_cast<MetadataFields>(~static_cast<std::uint8_t>(a)) & MetadataFields::All;
+}
+
+inline MetadataFields& operator|=(MetadataFields& a, MetadataFields b) {
+	return a = a | b;
+}
+
+///
+/// \brief has_fields true if every field of `wanted` is in `fields`
+constexpr bool has_fields(MetadataFields fields, MetadataFields wanted) {
+	return (fields & wanted) == wanted;
+}
+
+///
+/// Read-only view over the raw metadata of a resource, borrowing its strings.
+/// Unlike Metadata, it doesn't copy anything when constructed: the versions are only parsed on their first access
+/// and the custom metadata only copied when asked for. This makes checking a single field, e.g. the type of the
+/// resource, as cheap as reading the raw metadata.
+/// The view must not outlive the raw metadata it has been constructed from.
+/// It is not thread-safe, as the first access to a version modifies it.
+/// A view read with a field mask may only contain these fields: accessing another one throws std::logic_error.
+///
+class MetadataView {
+public:
+	///
+	/// \brief MetadataView Construct a view over raw metadata without custom metadata
+	/// \param type The raw type of the resource, only checked when accessed
+	/// \param format_version The unparsed version of the resource's format
+	/// \param tool_name The name of the tool used to generate this resource
+	/// \param tool_version The unparsed version of the tool used to generate this resource
+	/// \param tool_info Other information about the tool used to generate this resource
+	/// \param generation_date The date of the generation, in seconds since epoch
+	MetadataView(std::uint32_t type, std::experimental::string_view format_version,
+	             std::experimental::string_view tool_name, std::experimental::string_view tool_version,
+	             std::experimental::string_view tool_info, std::uint64_t generation_date)
+		: type_{type}
+		, format_version_str_{format_version}
+		, tool_name_{tool_name}
+		, tool_version_str_{tool_version}
+		, tool_info_{tool_info}
+		, generation_date_{generation_date}
+	{
+	}
+
+	///
+	/// \brief MetadataView Construct a view over raw metadata with custom metadata
+	/// \param custom_metadata A range of key/value pairs, borrowed as well: it must outlive the view
+	/// The other parameters are the same as without custom metadata.
+	template <typename CustomRange>
+	MetadataView(std::uint32_t type, std::experimental::string_view format_version,
+	             std::experimental::string_view tool_name, std::experimental::string_view tool_version,
+	             std::experimental::string_view tool_info, std::uint64_t generation_date,
+	             const CustomRange& custom_metadata)
+		: MetadataView(type, format_version, tool_name, tool_version, tool_info, generation_date)
+	{
+		custom_metadata_ = &custom_metadata;
+		copy_custom_metadata_ = [](const void* custom) {
+			const auto& range = *static_cast<const CustomRange*>(custom);
+			return CustomMetadata(range.begin(), range.end());
+		};
+	}
+
+	// The view would keep a pointer to the temporary range
+	template <typename CustomRange>
+	MetadataView(std::uint32_t type, std::experimental::string_view format_version,
+	             std::experimental::string_view tool_name, std::experimental::string_view tool_version,
+	             std::experimental::string_view tool_info, std::uint64_t generation_date,
+	             const CustomRange&& custom_metadata) = delete;
+
+	///
+	/// \brief from_type Construct a view containing only the type of the resource
+	/// \param type The raw type of the resource, only checked when accessed
+	static MetadataView from_type(std::uint32_t type) {
+		return MetadataView(type, {}, {}, {}, {}, 0).restrict_fields(MetadataFields::Type);
+	}
+
+	///
+	/// \brief restrict_fields Only keep some fields in this view, e.g. because the others have not been read
+	/// \param fields The fields to keep, accessing the others throws std::logic_error
+	MetadataView& restrict_fields(MetadataFields fields) {
+		fields_ = fields_ & fields;
+		return *this;
+	}
+
+	///
+	/// \brief fields get the fields available in this view
+	MetadataFields fields() const { return fields_; }
+
+	///
+	/// \brief type get the resource type of the viewed metadata
+	/// \throws UnknownMetadataTypeError if the resource type is unknown
+	ResourceType type() const;
+
+	///
+	/// \brief format_version get the format version of the viewed metadata, parsed on the first call
+	/// \throws MetadataError if the version is ill-formed
+	/// \throws std::out_of_range if a numerical identifier in the version doesn't fit in a std::uint64_t
+	const Version& format_version() const;
+
+	///
+	/// \brief format_version_string get the format version of the viewed metadata, without parsing it
+	std::experimental::string_view format_version_string() const {
+		check_fields(MetadataFields::FormatVersion);
+		return format_version_str_;
+	}
+
+	///
+	/// \brief tool_name get the tool name of the viewed metadata
+	std::experimental::string_view tool_name() const {
+		check_fields(MetadataFields::ToolName);
+		return tool_name_;
+	}
+
+	///
+	/// \brief tool_version get the tool version of the viewed metadata, parsed on the first call
+	/// \throws MetadataError if the version is ill-formed
+	/// \throws std::out_of_range if a numerical identifier in the version doesn't fit in a std::uint64_t
+	const Version& tool_version() const;
+
+	///
+	/// \brief tool_version_string get the tool version of the viewed metadata, without parsing it
+	std::experimental::string_view tool_version_string() const {
+		check_fields(MetadataFields::ToolVersion);
+		return tool_version_str_;
+	}
+
+	///
+	/// \brief tool_info get the tool info of the viewed metadata
+	std::experimental::string_view tool_info() const {
+		check_fields(MetadataFields::ToolInfo);
+		return tool_info_;
+	}
+
+	///
+	/// \brief generation_date get the generation date of the viewed metadata
+	std::chrono::system_clock::time_point generation_date() const {
+		check_fields(MetadataFields::GenerationDate);
+		return std::chrono::system_clock::time_point{std::chrono::seconds(generation_date_)};
+	}
+
+	///
+	/// \brief custom_metadata get a copy of the custom metadata of the viewed metadata
+	/// \throws MetadataError if the custom metadata are not printable
+	CustomMetadata custom_metadata() const;
+
+	///
+	/// \brief to_metadata Construct an owning metadata from the viewed metadata
+	/// Reuses the versions that have already been parsed. The view must contain all the fields.
+	/// \throws MetadataError if the version or the resource type are ill-formed, or custom metadata not printable
+	/// \throws std::out_of_range if a numerical identifier in the version doesn't fit in a std::uint64_t
+	Metadata to_metadata() const;
+
+private:
+	void check_fields(MetadataFields wanted) const {
+		if (!has_fields(fields_, wanted)) {
+			throw std::logic_error("This metadata field has not been read");
+		}
+	}
+
+	MetadataFields fields_ = MetadataFields::All;
+
+	std::uint32_t type_;
+	std::experimental::string_view format_version_str_;
+	std::experimental::string_view tool_name_;
+	std::experimental::string_view tool_version_str_;
+	std::experimental::string_view tool_info_;
+	std::uint64_t generation_date_;
+
+	// Type-erased range of key/value pairs, null if the resource doesn't support custom metadata
+	const void* custom_metadata_ = nullptr;
+	CustomMetadata (*copy_custom_metadata_)(const void*) = nullptr;
+
+	mutable boost::optional<Version> format_version_;
+	mutable boost::optional<Version> tool_version_;
+};
+
+}} // namespace reven::metadata
@@ -0,0 +1,96 @@
+#include "metadata-bin-header.h"
+
+#include <cstring>
+
+namespace reven {
+namespace metadata {
+namespace binheader {
+
+namespace {
+
+// Version of the metadata that follows the current magic
+constexpr std::uint32_t metadata_version = 1;
+
+// Tool version of the resources with the legacy magic, which don't store it
+constexpr char legacy_tool_version[] = "1.0.0-prerelease";
+
+// Size of the buffers of the fixed size strings, which are preceded by their length
+constexpr std::size_t version_buffer_size = 0x200;
+constexpr std::size_t name_buffer_size = 0x200;
+constexpr std::size_t info_buffer_size = 0x800;
+
+///
+/// Offsets of the metadata fields in the header
+///
+struct HeaderLayout {
+	std::size_t type;
+	std::size_t format_version;
+	std::size_t tool_name;
+	std::size_t tool_version;
+	std::size_t tool_info;
+	std::size_t generation_date;
+};
+
+constexpr HeaderLayout layout = {0xc, 0x10, 0x218, 0x420, 0x628, 0xe30};
+constexpr HeaderLayout legacy_layout = {0x8, 0xc, 0x214, 0, 0x41c, 0xc24};
+
+static_assert(layout.generation_date + sizeof(std::uint64_t) == header_size, "Inconsistent header layout");
+static_assert(legacy_layout.generation_date + sizeof(std::uint64_t) == legacy_header_size,
+              "Inconsistent legacy header layout");
+
+template <typename T>
+T read(const char* data, std::size_t offset) {
+	T value;
+	std::memcpy(&value, data + offset, sizeof(value));
+	return value;
+}
+
+// Read a string stored as its length followed by a buffer of `buffer_size` bytes, false if the length is invalid
+bool read_string(const char* data, std::size_t offset, std::size_t buffer_size, std::experimental::string_view& str) {
+	const auto length = read<std::uint64_t>(data, offset);
+	if (length > buffer_size) {
+		return false;
+	}
+
+	str = std::experimental::string_view(data + offset + sizeof(std::uint64_t), static_cast<std::size_t>(length));
+	return true;
+}
+
+} // anonymous namespace
+
+boost::optional<MetadataView> view(const char* data, std::size_t size, std::size_t& header_size_used) {
+	const bool is_current = size >= header_size && std::memcmp(data, magic, sizeof(magic) - 1) == 0;
+	const bool is_legacy = !is_current && size >= legacy_header_size &&
+	                       std::memcmp(data, legacy_magic, sizeof(legacy_magic) - 1) == 0;
+
+	if (!is_current && !is_legacy) {
+		return boost::none;
+	}
+
+	if (is_current && read<std::uint32_t>(data, sizeof(magic) - 1) != metadata_version) {
+		return boost::none;
+	}
+
+	const auto& fields = is_current ? layout : legacy_layout;
+
+	std::experimental::string_view format_version;
+	std::experimental::string_view tool_name;
+	std::experimental::string_view tool_version = legacy_tool_version;
+	std::experimental::string_view tool_info;
+
+	if (!read_string(data, fields.format_version, version_buffer_size, format_version) ||
+	    !read_string(data, fields.tool_name, name_buffer_size, tool_name) ||
+	    (is_current && !read_string(data, fields.tool_version, version_buffer_size, tool_version)) ||
+	    !read_string(data, fields.tool_info, info_buffer_size, tool_info)) {
+		return boost::none;
+	}
+
+	header_size_used = is_current ? header_size : legacy_header_size;
+	return MetadataView(
+		read<std::uint32_t>(data, fields.type), format_version,
+		tool_name, tool_version, tool_info,
+		read<std::uint64_t>(data, fields.generation_date)
+	);
+}
+
+}}} // namespace reven::metadata::binheader
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/optional.hpp>
+
+#include "metadata-view.h"
+
+namespace reven {
+namespace metadata {
+namespace binheader {
+
+// Magic at the start of the binary resources, both the current one and the one without metadata version
+constexpr char magic[] = "srnibnvr";
+constexpr char legacy_magic[] = "crsrnibr";
+
+// Size of the fixed header holding the metadata, for the current and the legacy magic
+constexpr std::size_t header_size = 0xe38;
+constexpr std::size_t legacy_header_size = 0xc2c;
+
+///
+/// \brief view Decode the metadata of a binary resource from its fixed header, borrowing the strings of `data`
+/// Only the metadata fields are decoded, without checking anything else in the resource.
+/// \param data The first bytes of the resource
+/// \param size The number of bytes in `data`
+/// \param header_size_used Set to the number of bytes of `data` holding the header, on success
+/// \return none if `data` doesn't hold a complete header of a known version. The binresource reader must then be
+///   used to get its result or error.
+boost::optional<MetadataView> view(const char* data, std::size_t size, std::size_t& header_size_used);
+
+}}} // namespace reven::metadata::binheader
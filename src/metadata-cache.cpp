@@ -0,0 +1,253 @@
+#include "metadata-cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace reven {
+namespace metadata {
+
+namespace {
+
+// Closes the file descriptor on scope exit
+class FileDescriptor {
+public:
+	explicit FileDescriptor(int fd) : fd_(fd) {}
+	~FileDescriptor() {
+		if (fd_ >= 0) {
+			::close(fd_);
+		}
+	}
+
+	FileDescriptor(const FileDescriptor&) = delete;
+	FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+	int get() const { return fd_; }
+
+private:
+	int fd_;
+};
+
+MetadataCache& process_cache() {
+	static MetadataCache cache(0);
+	return cache;
+}
+
+std::atomic<bool> process_cache_enabled{false};
+
+} // anonymous namespace
+
+constexpr std::size_t MetadataCache::shard_count;
+
+MetadataCache::MetadataCache(std::size_t capacity)
+	: capacity_(capacity)
+{
+}
+
+namespace {
+
+template <typename FileState>
+void to_file_state(const struct stat& st, FileState& state) {
+	state.key = {static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+	state.size = static_cast<std::int64_t>(st.st_size);
+	state.mtime_sec = static_cast<std::int64_t>(st.st_mtim.tv_sec);
+	state.mtime_nsec = static_cast<std::int64_t>(st.st_mtim.tv_nsec);
+}
+
+} // anonymous namespace
+
+bool MetadataCache::stat_fd(int fd, FileState& state) {
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		return false;
+	}
+
+	to_file_state(st, state);
+	return true;
+}
+
+bool MetadataCache::stat_file(const char* filename, FileState& state) {
+	struct stat st;
+	if (::fstatat(AT_FDCWD, filename, &st, 0) != 0) {
+		return false;
+	}
+
+	to_file_state(st, state);
+	return true;
+}
+
+std::size_t MetadataCache::shard_capacity() const {
+	return (capacity_ + shard_count - 1) / shard_count;
+}
+
+Metadata MetadataCache::get(const char* filename, const Loader& load) {
+	// The file stays open during the load, so its inode can't be reused for another file until the check below
+	const FileDescriptor fd(::open(filename, O_RDONLY | O_CLOEXEC));
+
+	FileState state;
+	if (fd.get() < 0 || !stat_fd(fd.get(), state)) {
+		// Let the loader report the error the way it would without the cache
+		return load(filename);
+	}
+
+	auto& file_shard = shard(state.key);
+
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+
+		const auto it = file_shard.index.find(state.key);
+		if (it != file_shard.index.end()) {
+			auto& entry = *file_shard.entries[it->second];
+			if (entry.state.same_content(state)) {
+				// Only write to the entry when the clock hand has cleared the flag
+				if (!entry.referenced.load(std::memory_order_relaxed)) {
+					entry.referenced.store(true, std::memory_order_relaxed);
+				}
+				file_shard.hits.fetch_add(1, std::memory_order_relaxed);
+				return entry.md;
+			}
+		}
+	}
+
+	file_shard.misses.fetch_add(1, std::memory_order_relaxed);
+
+	// The loaders open the resource by name, so the file that was read may not be the one that was stat'ed if it
+	// was replaced meanwhile. Only store the metadata if the name still refers to the open file, and that file
+	// wasn't modified during the read. Otherwise they will be read again on the next lookup.
+	auto md = load(filename);
+
+	FileState fd_state;
+	FileState file_state;
+	if (stat_fd(fd.get(), fd_state) && fd_state.key == state.key && fd_state.same_content(state)
+	    && stat_file(filename, file_state) && file_state.key == state.key && file_state.same_content(state)) {
+		store(state, md);
+	}
+	return md;
+}
+
+void MetadataCache::update(const char* filename, const Metadata& md) {
+	FileState state;
+	if (!stat_file(filename, state)) {
+		return;
+	}
+
+	store(state, md);
+}
+
+void MetadataCache::invalidate(const char* filename) {
+	FileState state;
+	if (!stat_file(filename, state)) {
+		return;
+	}
+
+	auto& file_shard = shard(state.key);
+	std::unique_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+
+	const auto it = file_shard.index.find(state.key);
+	if (it != file_shard.index.end()) {
+		remove(file_shard, it->second);
+	}
+}
+
+void MetadataCache::clear() {
+	for (auto& file_shard : shards_) {
+		std::unique_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+		file_shard.entries.clear();
+		file_shard.index.clear();
+		file_shard.hand = 0;
+	}
+}
+
+void MetadataCache::set_capacity(std::size_t capacity) {
+	capacity_ = capacity;
+
+	const auto max_size = shard_capacity();
+	for (auto& file_shard : shards_) {
+		std::unique_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+		evict(file_shard, max_size);
+	}
+}
+
+MetadataCache::Stats MetadataCache::stats() const {
+	Stats stats{0, 0, 0, 0};
+
+	for (const auto& file_shard : shards_) {
+		stats.hits += file_shard.hits.load(std::memory_order_relaxed);
+		stats.misses += file_shard.misses.load(std::memory_order_relaxed);
+		stats.evictions += file_shard.evictions.load(std::memory_order_relaxed);
+
+		std::shared_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+		stats.size += file_shard.entries.size();
+	}
+
+	return stats;
+}
+
+void MetadataCache::store(const FileState& state, const Metadata& md) {
+	const auto max_size = shard_capacity();
+	if (max_size == 0) {
+		return;
+	}
+
+	std::unique_ptr<Entry> entry(new Entry(state, md));
+
+	auto& file_shard = shard(state.key);
+	std::unique_lock<std::shared_timed_mutex> lock(file_shard.mutex);
+
+	const auto it = file_shard.index.find(state.key);
+	if (it != file_shard.index.end()) {
+		entry->referenced.store(true, std::memory_order_relaxed);
+		file_shard.entries[it->second] = std::move(entry);
+		return;
+	}
+
+	evict(file_shard, max_size - 1);
+	file_shard.index.emplace(state.key, file_shard.entries.size());
+	file_shard.entries.push_back(std::move(entry));
+}
+
+void MetadataCache::remove(Shard& file_shard, std::size_t position) {
+	// Move the last entry in place of the removed one
+	file_shard.index.erase(file_shard.entries[position]->state.key);
+	if (position + 1 != file_shard.entries.size()) {
+		file_shard.entries[position] = std::move(file_shard.entries.back());
+		file_shard.index[file_shard.entries[position]->state.key] = position;
+	}
+	file_shard.entries.pop_back();
+
+	if (file_shard.hand >= file_shard.entries.size()) {
+		file_shard.hand = 0;
+	}
+}
+
+void MetadataCache::evict(Shard& file_shard, std::size_t max_size) {
+	while (file_shard.entries.size() > max_size) {
+		// Give a second chance to the entries used since the last pass. This terminates since the flags are cleared
+		// under the exclusive lock, and at most one pass is needed.
+		auto& entry = *file_shard.entries[file_shard.hand];
+		if (entry.referenced.load(std::memory_order_relaxed)) {
+			entry.referenced.store(false, std::memory_order_relaxed);
+			file_shard.hand = (file_shard.hand + 1) % file_shard.entries.size();
+			continue;
+		}
+
+		remove(file_shard, file_shard.hand);
+		file_shard.evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void enable_metadata_cache(std::size_t capacity) {
+	process_cache().set_capacity(capacity);
+	process_cache_enabled = true;
+}
+
+void disable_metadata_cache() {
+	process_cache_enabled = false;
+	process_cache().clear();
+}
+
+MetadataCache* process_metadata_cache() {
+	return process_cache_enabled ? &process_cache() : nullptr;
+}
+
+}} // namespace reven::metadata
@@ -0,0 +1,536 @@
+#include "metadata-catalog.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include <sqlite3.h>
+
+#include <boost/filesystem.hpp>
+
+#include "metadata-file.h"
+
+namespace reven {
+namespace metadata {
+
+namespace {
+
+// Version 2 clamps the version numbers that don't fit in a sqlite integer, which version 1 stored as negative values
+constexpr int catalog_version = 2;
+
+constexpr std::int64_t max_version_number = std::numeric_limits<std::int64_t>::max();
+
+constexpr const char* catalog_schema =
+	"CREATE TABLE IF NOT EXISTS files ("
+	"  path TEXT PRIMARY KEY NOT NULL,"
+	"  device INTEGER NOT NULL, inode INTEGER NOT NULL,"
+	"  size INTEGER NOT NULL, mtime_sec INTEGER NOT NULL, mtime_nsec INTEGER NOT NULL,"
+	// The metadata columns are NULL if the file isn't a resource
+	"  type INTEGER,"
+	"  format_version TEXT,"
+	// The version numbers are clamped to max_version_number, the full versions are in the text columns
+	"  format_major INTEGER, format_minor INTEGER, format_patch INTEGER, format_prerelease INTEGER,"
+	"  tool_name TEXT,"
+	"  tool_version TEXT,"
+	"  tool_major INTEGER, tool_minor INTEGER, tool_patch INTEGER, tool_prerelease INTEGER,"
+	"  tool_info TEXT,"
+	"  generation_date INTEGER"
+	");"
+	"CREATE TABLE IF NOT EXISTS custom_metadata ("
+	"  path TEXT NOT NULL, key TEXT NOT NULL, value TEXT NOT NULL,"
+	"  PRIMARY KEY (path, key)"
+	");"
+	"CREATE INDEX IF NOT EXISTS files_type ON files(type);"
+	"CREATE INDEX IF NOT EXISTS files_tool ON files(tool_name, tool_major, tool_minor, tool_patch);"
+	"CREATE INDEX IF NOT EXISTS files_format ON files(format_major, format_minor, format_patch);"
+	"CREATE INDEX IF NOT EXISTS custom_metadata_key_value ON custom_metadata(key, value);";
+
+// Clamp to max_version_number the version numbers that version 1 stored as negative values
+constexpr const char* catalog_upgrade_from_1 =
+	"UPDATE files SET format_major = 9223372036854775807 WHERE format_major < 0;"
+	"UPDATE files SET format_minor = 9223372036854775807 WHERE format_minor < 0;"
+	"UPDATE files SET format_patch = 9223372036854775807 WHERE format_patch < 0;"
+	"UPDATE files SET tool_major = 9223372036854775807 WHERE tool_major < 0;"
+	"UPDATE files SET tool_minor = 9223372036854775807 WHERE tool_minor < 0;"
+	"UPDATE files SET tool_patch = 9223372036854775807 WHERE tool_patch < 0;";
+
+[[noreturn]] void throw_error(sqlite3* db, const std::string& context) {
+	throw CatalogError((context + ": " + sqlite3_errmsg(db)).c_str());
+}
+
+void exec(sqlite3* db, const char* sql) {
+	char* error = nullptr;
+	if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+		const std::string message = error != nullptr ? error : sqlite3_errmsg(db);
+		sqlite3_free(error);
+		throw CatalogError(("Catalog error: " + message).c_str());
+	}
+}
+
+///
+/// RAII wrapper around a sqlite prepared statement
+///
+class Statement {
+public:
+	Statement(sqlite3* db, const std::string& sql) : db_(db) {
+		if (sqlite3_prepare_v2(db, sql.c_str(), static_cast<int>(sql.size()), &stmt_, nullptr) != SQLITE_OK) {
+			throw_error(db, "Cannot prepare catalog statement");
+		}
+	}
+
+	~Statement() {
+		sqlite3_finalize(stmt_);
+	}
+
+	Statement(const Statement&) = delete;
+	Statement& operator=(const Statement&) = delete;
+
+	void bind(int index, std::int64_t value) {
+		check(sqlite3_bind_int64(stmt_, index, value));
+	}
+
+	void bind(int index, const std::string& value) {
+		check(sqlite3_bind_text(stmt_, index, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT));
+	}
+
+	/// Return true if a row is available
+	bool step() {
+		const int result = sqlite3_step(stmt_);
+		if (result == SQLITE_ROW) {
+			return true;
+		} else if (result == SQLITE_DONE) {
+			return false;
+		}
+		throw_error(db_, "Cannot execute catalog statement");
+	}
+
+	void reset() {
+		sqlite3_reset(stmt_);
+		sqlite3_clear_bindings(stmt_);
+	}
+
+	std::int64_t column_int(int index) const {
+		return sqlite3_column_int64(stmt_, index);
+	}
+
+	std::string column_text(int index) const {
+		const auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, index));
+		return text != nullptr ? std::string(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt_, index)))
+		                       : std::string();
+	}
+
+private:
+	void check(int result) {
+		if (result != SQLITE_OK) {
+			throw_error(db_, "Cannot bind catalog statement parameter");
+		}
+	}
+
+	sqlite3* db_;
+	sqlite3_stmt* stmt_ = nullptr;
+};
+
+///
+/// Rollback the transaction if it isn't committed
+///
+class Transaction {
+public:
+	explicit Transaction(sqlite3* db) : db_(db) {
+		exec(db_, "BEGIN");
+	}
+
+	~Transaction() {
+		if (!committed_) {
+			sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+		}
+	}
+
+	void commit() {
+		exec(db_, "COMMIT");
+		committed_ = true;
+	}
+
+private:
+	sqlite3* db_;
+	bool committed_ = false;
+};
+
+struct FileState {
+	std::int64_t device;
+	std::int64_t inode;
+	std::int64_t size;
+	std::int64_t mtime_sec;
+	std::int64_t mtime_nsec;
+
+	bool operator==(const FileState& state) const {
+		return device == state.device && inode == state.inode && size == state.size
+		       && mtime_sec == state.mtime_sec && mtime_nsec == state.mtime_nsec;
+	}
+};
+
+bool stat_file(const std::string& path, FileState& state) {
+	struct stat st;
+	if (::stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+
+	state = {
+		static_cast<std::int64_t>(st.st_dev), static_cast<std::int64_t>(st.st_ino), static_cast<std::int64_t>(st.st_size),
+		static_cast<std::int64_t>(st.st_mtim.tv_sec), static_cast<std::int64_t>(st.st_mtim.tv_nsec),
+	};
+	return true;
+}
+
+// Regular files under the root (or the root itself if it is a file), symlinks to directories aren't followed
+std::vector<std::string> list_files(const boost::filesystem::path& root) {
+	namespace fs = boost::filesystem;
+
+	std::vector<std::string> files;
+	boost::system::error_code ec;
+
+	if (fs::is_regular_file(root, ec)) {
+		files.push_back(root.string());
+		return files;
+	}
+
+	fs::recursive_directory_iterator it(root, ec);
+	const fs::recursive_directory_iterator end;
+	for (; !ec && it != end; it.increment(ec)) {
+		if (fs::is_regular_file(it->symlink_status())) {
+			files.push_back(it->path().string());
+		}
+	}
+
+	return files;
+}
+
+// Whether `version` respects the [min, max) bounds
+bool in_bounds(const Version& version, const boost::optional<Version>& min, const boost::optional<Version>& max) {
+	return (!min || version >= *min) && (!max || version < *max);
+}
+
+// The value stored for a version number, sqlite integers being signed
+std::int64_t version_number(std::uint64_t number) {
+	return static_cast<std::int64_t>(std::min<std::uint64_t>(number, max_version_number));
+}
+
+void bind_version(Statement& stmt, int& index, const Version& version) {
+	stmt.bind(index++, version_number(version.major()));
+	stmt.bind(index++, version_number(version.minor()));
+	stmt.bind(index++, version_number(version.patch()));
+	stmt.bind(index++, static_cast<std::int64_t>(!version.prerelease().empty()));
+}
+
+// The SQL condition preselecting the rows whose version could be in the bounds, the exact bounds are checked on the
+// parsed versions.
+// The rows are compared by (major, minor, patch, release), where release is 1 if there is no prerelease part, as a
+// release comes after its prereleases. A version < max has a key <= (max numbers, 0): a release with the same numbers
+// as max isn't below it.
+void add_version_condition(std::string& sql, const char* prefix, bool has_min, bool has_max) {
+	const std::string key = std::string("(") + prefix + "_major, " + prefix + "_minor, " + prefix + "_patch, NOT "
+	                        + prefix + "_prerelease)";
+	if (has_min) {
+		sql += " AND " + key + " >= (?, ?, ?, ?)";
+	}
+	if (has_max) {
+		sql += " AND " + key + " <= (?, ?, ?, ?)";
+	}
+}
+
+// Bind the key of a bound, see add_version_condition.
+// After a clamped number, the rest of the key is set to what includes every row sharing the clamped numbers.
+void bind_version_bound(Statement& stmt, int& index, const Version& version, bool is_min) {
+	std::int64_t key[] = {
+		version_number(version.major()), version_number(version.minor()), version_number(version.patch()),
+		is_min ? static_cast<std::int64_t>(version.prerelease().empty()) : 0
+	};
+	const auto clamped = std::find(std::begin(key), std::end(key) - 1, max_version_number);
+	if (clamped != std::end(key) - 1) {
+		std::fill(clamped + 1, std::end(key), is_min ? 0 : max_version_number);
+	}
+	for (const auto number : key) {
+		stmt.bind(index++, number);
+	}
+}
+
+// Return true if the error means that the file isn't a resource, rather than a resource that can't be read
+bool is_unknown_resource(const std::exception_ptr& error) {
+	try {
+		std::rethrow_exception(error);
+	} catch (const UnknownResourceError&) {
+		return true;
+	} catch (...) {
+		return false;
+	}
+}
+
+} // anonymous namespace
+
+void Catalog::DatabaseDeleter::operator()(sqlite3* db) const {
+	sqlite3_close(db);
+}
+
+Catalog::Catalog(std::unique_ptr<sqlite3, DatabaseDeleter> db) : db_(std::move(db)) {}
+Catalog::Catalog(Catalog&&) = default;
+Catalog& Catalog::operator=(Catalog&&) = default;
+Catalog::~Catalog() = default;
+
+Catalog Catalog::open(const char* filename) {
+	sqlite3* raw_db = nullptr;
+	const int result = sqlite3_open_v2(filename, &raw_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+	std::unique_ptr<sqlite3, DatabaseDeleter> db(raw_db);
+
+	if (result != SQLITE_OK) {
+		throw CatalogError((std::string("Cannot open catalog ") + filename + ": "
+		                   + (raw_db != nullptr ? sqlite3_errmsg(raw_db) : sqlite3_errstr(result))).c_str());
+	}
+
+	Statement version_stmt(db.get(), "PRAGMA user_version");
+	version_stmt.step();
+	const auto version = version_stmt.column_int(0);
+
+	if (version == 0) {
+		Transaction transaction(db.get());
+		exec(db.get(), catalog_schema);
+		exec(db.get(), ("PRAGMA user_version = " + std::to_string(catalog_version)).c_str());
+		transaction.commit();
+	} else if (version == 1) {
+		Transaction transaction(db.get());
+		exec(db.get(), catalog_upgrade_from_1);
+		exec(db.get(), ("PRAGMA user_version = " + std::to_string(catalog_version)).c_str());
+		transaction.commit();
+	} else if (version != catalog_version) {
+		throw CatalogError(("Unsupported catalog version " + std::to_string(version)).c_str());
+	}
+
+	return Catalog(std::move(db));
+}
+
+Catalog::UpdateStats Catalog::update(const std::vector<std::string>& roots, unsigned thread_count) {
+	UpdateStats stats{0, 0, 0, 0, 0};
+
+	for (const auto& root_str : roots) {
+		boost::system::error_code ec;
+		auto root = boost::filesystem::canonical(root_str, ec);
+		if (ec) {
+			// The root doesn't exist anymore: forget everything under it
+			root = boost::filesystem::absolute(root_str);
+		}
+
+		// The state of the files under the root the last time they were read
+		// The prefix is a range rather than a function of the path so the primary key index is used, 0xff never
+		// occurs in UTF-8
+		std::unordered_map<std::string, FileState> known_files;
+		{
+			Statement stmt(db_.get(), "SELECT path, device, inode, size, mtime_sec, mtime_nsec FROM files "
+			                          "WHERE path = ? OR (path >= ? AND path < ?)");
+			const auto prefix = (root / "").string();
+			stmt.bind(1, root.string());
+			stmt.bind(2, prefix);
+			stmt.bind(3, prefix + '\xff');
+			while (stmt.step()) {
+				known_files.emplace(stmt.column_text(0), FileState{
+					stmt.column_int(1), stmt.column_int(2), stmt.column_int(3), stmt.column_int(4), stmt.column_int(5)
+				});
+			}
+		}
+
+		std::vector<std::string> changed_files;
+		std::vector<FileState> changed_states;
+
+		for (auto& file : list_files(root)) {
+			++stats.scanned;
+
+			FileState state;
+			if (!stat_file(file, state)) {
+				continue;
+			}
+
+			auto it = known_files.find(file);
+			if (it != known_files.end()) {
+				const bool unchanged = it->second == state;
+				known_files.erase(it);
+				if (unchanged) {
+					continue;
+				}
+			}
+
+			changed_files.push_back(std::move(file));
+			changed_states.push_back(state);
+		}
+
+		// The state is taken before reading: a file modified during the update will be read again next time
+		const auto results = from_resources(changed_files, thread_count);
+		stats.read += changed_files.size();
+
+		Transaction transaction(db_.get());
+
+		Statement insert_file(db_.get(),
+			"INSERT OR REPLACE INTO files (path, device, inode, size, mtime_sec, mtime_nsec, type,"
+			"  format_version, format_major, format_minor, format_patch, format_prerelease,"
+			"  tool_name, tool_version, tool_major, tool_minor, tool_patch, tool_prerelease, tool_info, generation_date)"
+			" VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+		Statement delete_file(db_.get(), "DELETE FROM files WHERE path = ?");
+		Statement delete_custom(db_.get(), "DELETE FROM custom_metadata WHERE path = ?");
+		Statement insert_custom(db_.get(), "INSERT INTO custom_metadata (path, key, value) VALUES (?, ?, ?)");
+
+		for (std::size_t i = 0; i < changed_files.size(); ++i) {
+			const auto& path = changed_files[i];
+			const auto& state = changed_states[i];
+
+			delete_custom.bind(1, path);
+			delete_custom.step();
+			delete_custom.reset();
+
+			if (!results[i].has_metadata() && !is_unknown_resource(results[i].error())) {
+				// The file may be a resource that couldn't be read this time: leave it out of the catalog so the
+				// next update reads it again
+				delete_file.bind(1, path);
+				delete_file.step();
+				delete_file.reset();
+
+				++stats.errors;
+				continue;
+			}
+
+			int index = 1;
+			insert_file.bind(index++, path);
+			insert_file.bind(index++, state.device);
+			insert_file.bind(index++, state.inode);
+			insert_file.bind(index++, state.size);
+			insert_file.bind(index++, state.mtime_sec);
+			insert_file.bind(index++, state.mtime_nsec);
+
+			if (results[i].has_metadata()) {
+				const auto& md = results[i].metadata();
+
+				insert_file.bind(index++, static_cast<std::int64_t>(md.type()));
+				insert_file.bind(index++, md.format_version().to_string());
+				bind_version(insert_file, index, md.format_version());
+				insert_file.bind(index++, md.tool_name().to_string());
+				insert_file.bind(index++, md.tool_version().to_string());
+				bind_version(insert_file, index, md.tool_version());
+				insert_file.bind(index++, md.tool_info().to_string());
+				insert_file.bind(index++, static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+					md.generation_date().time_since_epoch()).count()));
+
+				for (const auto& custom : md.custom_metadata()) {
+					insert_custom.bind(1, path);
+					insert_custom.bind(2, custom.first);
+					insert_custom.bind(3, custom.second);
+					insert_custom.step();
+					insert_custom.reset();
+				}
+			} else {
+				++stats.not_resources;
+				// Unbound parameters are NULL
+			}
+
+			insert_file.step();
+			insert_file.reset();
+		}
+
+		// What is left wasn't found under the root anymore
+		for (const auto& removed : known_files) {
+			delete_file.bind(1, removed.first);
+			delete_file.step();
+			delete_file.reset();
+
+			delete_custom.bind(1, removed.first);
+			delete_custom.step();
+			delete_custom.reset();
+
+			++stats.removed;
+		}
+
+		transaction.commit();
+	}
+
+	return stats;
+}
+
+std::vector<Catalog::Entry> Catalog::query(const Query& query) const {
+	std::string sql = "SELECT path, type, format_version, tool_name, tool_version, tool_info, generation_date "
+	                  "FROM files WHERE type IS NOT NULL";
+
+	if (query.type) {
+		sql += " AND type = ?";
+	}
+	if (query.tool_name) {
+		sql += " AND tool_name = ?";
+	}
+	add_version_condition(sql, "tool", bool(query.tool_version_min), bool(query.tool_version_max));
+	add_version_condition(sql, "format", bool(query.format_version_min), bool(query.format_version_max));
+	for (std::size_t i = 0; i < query.custom.size(); ++i) {
+		sql += " AND EXISTS (SELECT 1 FROM custom_metadata AS c WHERE c.path = files.path AND c.key = ? AND c.value = ?)";
+	}
+	if (query.path_prefix) {
+		// A range rather than a function of the path, so the primary key index is used. 0xff never occurs in UTF-8.
+		sql += " AND path >= ? AND path < ?";
+	}
+	sql += " ORDER BY path";
+
+	Statement stmt(db_.get(), sql);
+
+	int index = 1;
+	if (query.type) {
+		stmt.bind(index++, static_cast<std::int64_t>(*query.type));
+	}
+	if (query.tool_name) {
+		stmt.bind(index++, *query.tool_name);
+	}
+	for (const auto& bounds : {std::make_pair(&query.tool_version_min, &query.tool_version_max),
+	                           std::make_pair(&query.format_version_min, &query.format_version_max)}) {
+		if (*bounds.first) {
+			bind_version_bound(stmt, index, **bounds.first, true);
+		}
+		if (*bounds.second) {
+			bind_version_bound(stmt, index, **bounds.second, false);
+		}
+	}
+	for (const auto& custom : query.custom) {
+		stmt.bind(index++, custom.first);
+		stmt.bind(index++, custom.second);
+	}
+	if (query.path_prefix) {
+		stmt.bind(index++, *query.path_prefix);
+		stmt.bind(index++, *query.path_prefix + '\xff');
+	}
+
+	Statement custom_stmt(db_.get(), "SELECT key, value FROM custom_metadata WHERE path = ? ORDER BY key");
+
+	std::vector<Entry> entries;
+	while (stmt.step()) {
+		auto path = stmt.column_text(0);
+
+		// The versions of the entries are usually printed
+		auto format_version = Version::from_string(stmt.column_text(2), true);
+		auto tool_version = Version::from_string(stmt.column_text(4), true);
+
+		if (!in_bounds(format_version, query.format_version_min, query.format_version_max) ||
+		    !in_bounds(tool_version, query.tool_version_min, query.tool_version_max)) {
+			continue;
+		}
+
+		CustomMetadata custom_metadata;
+		custom_stmt.bind(1, path);
+		while (custom_stmt.step()) {
+			custom_metadata.emplace(custom_stmt.column_text(0), custom_stmt.column_text(1));
+		}
+		custom_stmt.reset();
+
+		Metadata md(
+			static_cast<ResourceType>(stmt.column_int(1)), std::move(format_version),
+			stmt.column_text(3), std::move(tool_version), stmt.column_text(5), std::move(custom_metadata),
+			std::chrono::system_clock::time_point{std::chrono::seconds(stmt.column_int(6))}
+		);
+
+		entries.push_back({std::move(path), std::move(md)});
+	}
+
+	return entries;
+}
+
+}} // namespace reven::metadata
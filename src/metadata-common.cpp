@@ -1,45 +1,224 @@
 #include "metadata-common.h"
+#include "metadata-validate.h"
+#include "metadata-stats-recorder.h"
 
 #include <algorithm>
-#include <sstream>
-#include <regex>
-
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/predicate.hpp>
+#include <cstring>
+#include <ctime>
+#include <limits>
 
 namespace reven {
 namespace metadata {
 
 namespace {
 
-bool is_number(const std::string& s) {
-	return !s.empty() && std::find_if(s.begin(), s.end(), [](char c) { return !std::isdigit(c); }) == s.end();
+bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+bool is_identifier_char(char c) {
+	return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-';
 }
 
+///
+/// Parser state used by Version::from_string
+/// Walks the string once and only allocates for alphanumeric identifiers.
+/// Errors that only depend on the value of a component (leading zero in a numeric identifier, number too big
+/// for a std::uint64_t) are recorded and thrown once the whole string is known to be well-formed, so an
+/// ill-formed string is always reported as such.
+///
+class VersionParser {
+public:
+	VersionParser(const char* begin, const char* end) : it_(begin), end_(end) {}
+
+	Version parse() {
+		const auto major = parse_version_number();
+		expect('.');
+		const auto minor = parse_version_number();
+		expect('.');
+		const auto patch = parse_version_number();
+
+		std::vector<Version::Identifier> prerelease;
+		std::vector<Version::Identifier> build;
+
+		if (it_ != end_ && *it_ == '-') {
+			++it_;
+			parse_identifiers(prerelease);
+		}
+
+		if (it_ != end_ && *it_ == '+') {
+			++it_;
+			parse_identifiers(build);
+		}
+
+		if (it_ != end_) {
+			throw_ill_formed();
+		}
+
+		switch (deferred_error_) {
+			case DeferredError::None:
+				break;
+			case DeferredError::LeadingZero:
+				throw MetadataError("Numeric identifier can't start with '0'");
+			case DeferredError::OutOfRange:
+				throw std::out_of_range("Version number doesn't fit in a std::uint64_t");
+		}
+
+		return Version(major, minor, patch, std::move(prerelease), std::move(build));
+	}
+
+private:
+	enum class DeferredError {
+		None,
+		LeadingZero,
+		OutOfRange,
+	};
+
+	[[noreturn]] static void throw_ill_formed() {
+		throw MetadataError("The string version isn't correct");
+	}
+
+	void defer(DeferredError error) {
+		if (deferred_error_ == DeferredError::None)
+			deferred_error_ = error;
+	}
+
+	void expect(char c) {
+		if (it_ == end_ || *it_ != c)
+			throw_ill_formed();
+		++it_;
+	}
+
+	// (0|[1-9][0-9]*)
+	std::uint64_t parse_version_number() {
+		if (it_ == end_ || !is_digit(*it_))
+			throw_ill_formed();
+
+		if (*it_ == '0') {
+			++it_;
+			return 0;
+		}
+
+		const char* begin = it_;
+		while (it_ != end_ && is_digit(*it_))
+			++it_;
+
+		return parse_number(begin, it_);
+	}
+
+	// [0-9a-zA-Z-]+[\.0-9a-zA-Z-]*
+	// Note: empty identifiers (e.g. "a..b") are accepted and kept as empty alphanumeric identifiers.
+	void parse_identifiers(std::vector<Version::Identifier>& identifiers) {
+		if (it_ == end_ || !is_identifier_char(*it_))
+			throw_ill_formed();
+
+		const char* begin = it_;
+		bool only_digits = true;
+
+		for (;; ++it_) {
+			if (it_ == end_ || *it_ == '.' || *it_ == '+') {
+				identifiers.push_back(make_identifier(begin, it_, only_digits));
+
+				if (it_ == end_ || *it_ == '+')
+					return;
+
+				begin = it_ + 1;
+				only_digits = true;
+			} else if (is_identifier_char(*it_)) {
+				only_digits = only_digits && is_digit(*it_);
+			} else {
+				throw_ill_formed();
+			}
+		}
+	}
+
+	Version::Identifier make_identifier(const char* begin, const char* end, bool only_digits) {
+		if (!only_digits || begin == end) {
+			return Version::Identifier(std::string(begin, end));
+		}
+
+		if (*begin == '0') {
+			defer(DeferredError::LeadingZero);
+			return Version::Identifier(0);
+		}
+
+		return Version::Identifier(parse_number(begin, end));
+	}
+
+	std::uint64_t parse_number(const char* begin, const char* end) {
+		std::uint64_t value = 0;
+		for (; begin != end; ++begin) {
+			const std::uint64_t digit = static_cast<std::uint64_t>(*begin - '0');
+			if (value > (std::numeric_limits<std::uint64_t>::max() - digit) / 10) {
+				defer(DeferredError::OutOfRange);
+				return 0;
+			}
+			value = value * 10 + digit;
+		}
+		return value;
+	}
+
+	const char* it_;
+	const char* end_;
+	DeferredError deferred_error_ = DeferredError::None;
+};
+
+}
+
+static_assert(sizeof(Version::Identifier) <= 3 * sizeof(std::uint64_t),
+              "Version::Identifier should stay as small as a std::string");
+
+constexpr std::size_t Version::Identifier::inline_capacity;
+
+void Version::Identifier::assign(const char* str, std::size_t size) {
+	if (size > std::numeric_limits<std::uint32_t>::max())
+		throw std::length_error("Alphanumeric identifier is too long");
+
+	if (size > inline_capacity) {
+		char* heap = new char[size];
+		std::memcpy(heap, str, size);
+		storage_.heap = heap;
+	} else if (size > 0) {
+		std::memcpy(storage_.chars, str, size);
+	}
+
+	size_ = static_cast<std::uint32_t>(size);
 }
 
 std::vector<Version::Identifier> Version::Identifier::from_string(const std::string& str) {
 	if (str.empty())
 		return {};
 
-	std::vector<std::string> tokens;
-	boost::split(tokens, str, boost::is_any_of("."));
-
 	std::vector<Version::Identifier> identifiers;
-	std::transform(
-		tokens.begin(), tokens.end(), std::back_inserter(identifiers),
-		[](const std::string& s) {
-			if (is_number(s)) {
-				if (s[0] == '0')
-					throw MetadataError("Numeric identifier can't start with '0'");
-
-				return Identifier(std::stoull(s));
-			}
+	identifiers.reserve(static_cast<std::size_t>(std::count(str.begin(), str.end(), '.')) + 1);
+
+	const char* begin = str.data();
+	const char* const end = str.data() + str.size();
+
+	for (;;) {
+		const char* token_end = std::find(begin, end, '.');
 
-			return Identifier(s);
+		if (begin != token_end && std::all_of(begin, token_end, is_digit)) {
+			if (*begin == '0')
+				throw MetadataError("Numeric identifier can't start with '0'");
+
+			std::uint64_t value = 0;
+			for (const char* it = begin; it != token_end; ++it) {
+				const std::uint64_t digit = static_cast<std::uint64_t>(*it - '0');
+				if (value > (std::numeric_limits<std::uint64_t>::max() - digit) / 10)
+					throw std::out_of_range("Numeric identifier doesn't fit in a std::uint64_t");
+				value = value * 10 + digit;
+			}
+			identifiers.emplace_back(value);
+		} else {
+			identifiers.emplace_back(std::string(begin, token_end));
 		}
-	);
+
+		if (token_end == end)
+			break;
+
+		begin = token_end + 1;
+	}
 
 	return identifiers;
 }
@@ -57,8 +236,8 @@ std::string Version::Identifier::to_string(const std::vector<Version::Identifier
 	return output;
 }
 
-Version Version::from_string(const std::string& str) {
-	// regex to match semver 2.0.0
+Version Version::from_string(std::experimental::string_view str, bool keep_string) {
+	// Single pass parser matching semver 2.0.0:
 	//  (1) major version (0 or unlimited number)
 	//  (2) minor version (0 or unlimited number)
 	//  (3) patch version (0 or unlimited number)
@@ -66,79 +245,325 @@ Version Version::from_string(const std::string& str) {
 	//      identifiers (alphanumeric letters and hyphens) separated by dots
 	//  (5) optional build following a plus consisting of
 	//      identifiers (alphanumeric letters and hyphens) separated by dots
-	std::regex regex("^"
-	                 "(0|[1-9][0-9]*)" // (1)
-	                 "\\.(0|[1-9][0-9]*)" // (2)
-	                 "\\.(0|[1-9][0-9]*)" // (3)
-	                 "(?:\\-([0-9a-zA-Z-]+[\\.0-9a-zA-Z-]*))?" // (4)
-	                 "(?:\\+([0-9a-zA-Z-]+[\\.0-9a-zA-Z-]*))?" // (5)
-	                 "$" , std::regex_constants::ECMAScript
-	);
-
-	std::smatch result;
-	if (!std::regex_search(str, result, regex)) {
-		throw MetadataError("The string version isn't correct");
+	auto version = VersionParser(str.data(), str.data() + str.size()).parse();
+
+	// The grammar doesn't allow leading zeros, so a well-formed string is already canonical
+	if (keep_string) {
+		version.string_ = str.to_string();
 	}
 
-	return Version(
-		std::stoull(result[1]), std::stoull(result[2]), std::stoull(result[3]),
-		Version::Identifier::from_string(result[4]),
-		Version::Identifier::from_string(result[5])
-	);
+	return version;
 }
 
-std::string Version::to_string() const {
-	std::stringstream ss;
+namespace {
+
+constexpr std::uint64_t max_key_number = 0xffffffff;
+constexpr std::uint64_t key_string_base = std::uint64_t(1) << 30;
+constexpr std::uint64_t key_release = (std::uint64_t(1) << 31) - 1;
+
+// Summary of the prerelease, ordered like the prerelease identifiers: numeric first identifiers, then
+// alphanumeric ones by their first three characters, then no prerelease at all.
+std::uint64_t key_prerelease(const std::vector<Version::Identifier>& prerelease) {
+	if (prerelease.empty())
+		return key_release;
+
+	const auto& first = prerelease.front();
+	if (first.type() == Version::Identifier::Type::Number)
+		return std::min(first.number(), key_string_base - 1);
+
+	const auto str = first.str();
+	std::uint64_t prefix = 0;
+	for (std::size_t i = 0; i < 3; ++i) {
+		prefix = (prefix << 8) | (i < str.size() ? static_cast<unsigned char>(str[i]) : 0);
+	}
+	return key_string_base + prefix;
+}
+
+}
+
+Version::SortKey Version::make_sort_key(const std::array<std::uint64_t, 3>& version_numbers,
+                                        const std::vector<Identifier>& prerelease) {
+	// Fields after a saturated one are left to 0, otherwise they could order two versions that only differ
+	// by the part of the saturated field that doesn't fit in the key.
+	std::uint64_t fields[4] = {0, 0, 0, 0};
+	bool exact = prerelease.empty();
+
+	for (std::size_t i = 0; i < 3; ++i) {
+		if (version_numbers[i] >= max_key_number) {
+			fields[i] = max_key_number;
+			exact = false;
+			break;
+		}
+		fields[i] = version_numbers[i];
+
+		if (i == 2) {
+			fields[3] = key_prerelease(prerelease);
+		}
+	}
 
-	ss << version_numbers_[0] << "." << version_numbers_[1] << "." << version_numbers_[2];
+	return {
+		(fields[0] << 32) | fields[1],
+		(fields[2] << 32) | (fields[3] << 1) | (exact ? 1 : 0)
+	};
+}
+
+namespace {
+
+///
+/// Bounded output used by Version::to_chars
+/// Writes as much as the buffer can hold, and counts the size of the whole output.
+///
+class CharsWriter {
+public:
+	CharsWriter(char* buffer, std::size_t size) : it_(buffer), end_(buffer + size) {}
+
+	void write(const char* str, std::size_t size) {
+		const auto count = std::min(size, static_cast<std::size_t>(end_ - it_));
+		if (count > 0) {
+			std::memcpy(it_, str, count);
+			it_ += count;
+		}
+		total_ += size;
+	}
+
+	void write(char c) {
+		write(&c, 1);
+	}
+
+	void write(std::uint64_t number) {
+		char digits[std::numeric_limits<std::uint64_t>::digits10 + 1];
+		char* const digits_end = digits + sizeof(digits);
+		char* first = digits_end;
+
+		do {
+			*--first = static_cast<char>('0' + number % 10);
+			number /= 10;
+		} while (number != 0);
+
+		write(first, static_cast<std::size_t>(digits_end - first));
+	}
+
+	void write(const std::vector<Version::Identifier>& identifiers) {
+		for (std::size_t i = 0; i < identifiers.size(); ++i) {
+			if (i > 0)
+				write('.');
+
+			const auto& id = identifiers[i];
+			if (id.type() == Version::Identifier::Type::Number) {
+				write(id.number());
+			} else {
+				write(id.str().data(), id.str().size());
+			}
+		}
+	}
+
+	std::size_t total() const { return total_; }
+
+private:
+	char* it_;
+	char* const end_;
+	std::size_t total_ = 0;
+};
+
+}
+
+std::size_t Version::to_chars(char* buffer, std::size_t size) const {
+	CharsWriter writer(buffer, size);
+
+	if (!string_.empty()) {
+		writer.write(string_.data(), string_.size());
+		return writer.total();
+	}
+
+	writer.write(version_numbers_[0]);
+	writer.write('.');
+	writer.write(version_numbers_[1]);
+	writer.write('.');
+	writer.write(version_numbers_[2]);
 
 	if (!prerelease_.empty()) {
-		ss << "-" << Version::Identifier::to_string(prerelease_);
+		writer.write('-');
+		writer.write(prerelease_);
 	}
 
 	if (!build_.empty()) {
-		ss << "+" << Version::Identifier::to_string(build_);
+		writer.write('+');
+		writer.write(build_);
 	}
 
-	return ss.str();
+	return writer.total();
 }
 
-namespace {
+std::string Version::to_string() const {
+	if (!string_.empty()) {
+		return string_;
+	}
 
+	char buffer[64];
+	const auto size = to_chars(buffer, sizeof(buffer));
+	if (size <= sizeof(buffer)) {
+		return std::string(buffer, size);
+	}
 
-bool is_valid_key(const std::string& s)
-{
-	return std::find_if(s.begin(), s.end(), [](char c) { return c == '.'; }) == s.end();
+	std::string output(size, '\0');
+	to_chars(&output[0], size);
+	return output;
 }
 
-bool is_printable(const std::string& s)
+namespace validate {
+
+void check_custom_metadata(const std::string& key, const std::string& value)
 {
-	return std::find_if(s.begin(), s.end(), [](char c) { return !std::isprint(c); }) == s.end();
+	const auto key_scan = scan(key.data(), key.size());
+	if (key_scan.first_unprintable != ScanResult::npos) {
+		throw MetadataError((std::string("Custom metadata key \"") + key +
+		                    "\" is not a printable string: invalid character at offset " +
+		                    std::to_string(key_scan.first_unprintable) + ".").c_str());
+	}
+	if (key_scan.first_dot != ScanResult::npos) {
+		throw MetadataError((std::string("Custom metadata key \"") + key +
+		                    "\" must not contain a \'.\' char: found at offset " +
+		                    std::to_string(key_scan.first_dot) + ".").c_str());
+	}
+
+	const auto value_scan = scan(value.data(), value.size());
+	if (value_scan.first_unprintable != ScanResult::npos) {
+		throw MetadataError((std::string("Custom metadata value \"") + value +
+		                    "\" is not a printable string: invalid character at offset " +
+		                    std::to_string(value_scan.first_unprintable) + ".").c_str());
+	}
 }
 
 void check_custom_metadata(const CustomMetadata& custom_metadata)
 {
+	stats::StageTimer timer(Stage::Validate);
+
 	for (const auto& custom : custom_metadata) {
-		if (not is_printable(custom.first)) {
-			throw MetadataError((std::string("Custom metadata key \"") + custom.first +
-			                    "\" is not a printable string.").c_str());
-		}
-		if (not is_valid_key(custom.first)) {
-			throw MetadataError((std::string("Custom metadata key \"") + custom.first +
-			                    "\" must not contain a \'.\' char.").c_str());
-		}
-		if (not is_printable(custom.second)) {
-			throw MetadataError((std::string("Custom metadata value \"") + custom.second +
-			                    "\" is not a printable string.").c_str());
-		}
+		check_custom_metadata(custom.first, custom.second);
+	}
+}
+
+} // namespace validate
+
+namespace {
+
+void check_resource_type(ResourceType type)
+{
+	if (type < ResourceType::_MinValue || type > ResourceType::_MaxValue) {
+		throw UnknownMetadataTypeError("Unknown resource type");
+	}
+}
+
+}
+
+void CustomMetadata::sort_entries() {
+	std::stable_sort(entries_.begin(), entries_.end(), [](const value_type& a, const value_type& b) {
+		return a.first < b.first;
+	});
+
+	entries_.erase(std::unique(entries_.begin(), entries_.end(), [](const value_type& a, const value_type& b) {
+		return a.first == b.first;
+	}), entries_.end());
+}
+
+const std::string& CustomMetadata::at(std::experimental::string_view key) const {
+	const auto it = find(key);
+	if (it == end()) {
+		throw std::out_of_range("Unknown custom metadata key");
+	}
+	return it->second;
+}
+
+std::string& CustomMetadata::operator[](std::string key) {
+	auto it = lower_bound(key);
+	if (it == entries_.end() || it->first != key) {
+		it = entries_.emplace(it, std::move(key), std::string());
+	}
+	return it->second;
+}
+
+std::pair<CustomMetadata::const_iterator, bool> CustomMetadata::emplace(std::string key, std::string value) {
+	// Entries are often inserted in order, e.g. when they are read from a sorted source
+	if (entries_.empty() || entries_.back().first < key) {
+		entries_.emplace_back(std::move(key), std::move(value));
+		return {entries_.end() - 1, true};
+	}
+
+	const auto it = lower_bound(key);
+	if (it != entries_.end() && it->first == key) {
+		return {it, false};
+	}
+	return {entries_.emplace(it, std::move(key), std::move(value)), true};
+}
+
+std::pair<CustomMetadata::const_iterator, bool> CustomMetadata::insert_or_assign(std::string key, std::string value) {
+	const auto it = lower_bound(key);
+	if (it != entries_.end() && it->first == key) {
+		it->second = std::move(value);
+		return {it, false};
+	}
+	return {entries_.emplace(it, std::move(key), std::move(value)), true};
+}
+
+CustomMetadata::size_type CustomMetadata::erase(std::experimental::string_view key) {
+	const auto it = lower_bound(key);
+	if (it == entries_.end() || it->first != key) {
+		return 0;
+	}
+	entries_.erase(it);
+	return 1;
+}
+
+PackedCustomMetadata::PackedCustomMetadata(const CustomMetadata& custom_metadata) {
+	size_type buffer_size = 0;
+	for (const auto& custom : custom_metadata) {
+		buffer_size += custom.first.size() + custom.second.size();
+	}
+
+	buffer_.resize(buffer_size);
+	entries_.reserve(custom_metadata.size());
+
+	char* data = buffer_.data();
+	for (const auto& custom : custom_metadata) {
+		const std::experimental::string_view key(data, custom.first.size());
+		data = std::copy(custom.first.begin(), custom.first.end(), data);
+		const std::experimental::string_view value(data, custom.second.size());
+		data = std::copy(custom.second.begin(), custom.second.end(), data);
+		entries_.emplace_back(key, value);
 	}
 }
 
+PackedCustomMetadata::PackedCustomMetadata(const PackedCustomMetadata& custom_metadata)
+	: buffer_(custom_metadata.buffer_)
+	, entries_(custom_metadata.entries_)
+{
+	// Point the copied views to the new buffer
+	const char* old_data = custom_metadata.buffer_.data();
+	const char* new_data = buffer_.data();
+	for (auto& entry : entries_) {
+		entry.first = std::experimental::string_view(new_data + (entry.first.data() - old_data), entry.first.size());
+		entry.second = std::experimental::string_view(new_data + (entry.second.data() - old_data), entry.second.size());
+	}
+}
+
+PackedCustomMetadata& PackedCustomMetadata::operator=(const PackedCustomMetadata& custom_metadata) {
+	if (this != &custom_metadata) {
+		*this = PackedCustomMetadata(custom_metadata);
+	}
+	return *this;
+}
+
+std::experimental::string_view PackedCustomMetadata::at(std::experimental::string_view key) const {
+	const auto it = find(key);
+	if (it == end()) {
+		throw std::out_of_range("Unknown custom metadata key");
+	}
+	return it->second;
 }
 
 Metadata::Metadata(ResourceType type, Version format_version,
                    std::string tool_name, Version tool_version, std::string tool_info,
-                   const CustomMetadata& custom_metadata,
+                   CustomMetadata custom_metadata,
                    std::chrono::system_clock::time_point generation_date)
 	: type_{type}
 	, format_version_{std::move(format_version)}
@@ -146,67 +571,182 @@ Metadata::Metadata(ResourceType type, Version format_version,
 	, tool_version_{std::move(tool_version)}
 	, tool_info_{std::move(tool_info)}
 	, generation_date_{std::chrono::time_point_cast<std::chrono::seconds>(generation_date)}
-	, custom_metadata_{custom_metadata}
+	, custom_metadata_{std::move(custom_metadata)}
 {
-	if (type_ < ResourceType::_MinValue || type_ > ResourceType::_MaxValue) {
-		throw UnknownMetadataTypeError("Unknown resource type");
+	check_resource_type(type_);
+	validate::check_custom_metadata(custom_metadata_);
+}
+
+MetadataBuilder& MetadataBuilder::type(ResourceType type) {
+	check_resource_type(type);
+	md_.type_ = type;
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::format_version(Version format_version) {
+	md_.format_version_ = std::move(format_version);
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::tool_name(std::string tool_name) {
+	md_.tool_name_ = std::move(tool_name);
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::tool_version(Version tool_version) {
+	md_.tool_version_ = std::move(tool_version);
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::tool_info(std::string tool_info) {
+	md_.tool_info_ = std::move(tool_info);
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::generation_date(std::chrono::system_clock::time_point generation_date) {
+	md_.generation_date_ = std::chrono::time_point_cast<std::chrono::seconds>(generation_date);
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::custom(std::string key, std::string value) {
+	validate::check_custom_metadata(key, value);
+	md_.custom_metadata_.insert_or_assign(std::move(key), std::move(value));
+	return *this;
+}
+
+MetadataBuilder& MetadataBuilder::custom_metadata(CustomMetadata custom_metadata) {
+	validate::check_custom_metadata(custom_metadata);
+	md_.custom_metadata_ = std::move(custom_metadata);
+	return *this;
+}
+
+namespace {
+
+///
+/// Name of a resource type, as used in the command line tools
+///
+struct ResourceTypeName {
+	ResourceType type;
+	const char* name;
+	std::size_t size;
+};
+
+template <std::size_t N>
+constexpr ResourceTypeName resource_type_name(ResourceType type, const char (&name)[N]) {
+	return {type, name, N - 1};
+}
+
+///
+/// Registry of the resource types, from which both `to_string` and `to_resource_type` are generated.
+/// Must contain every type, in the order of their values: this is checked at compile time below.
+///
+constexpr ResourceTypeName resource_type_names[] = {
+	resource_type_name(ResourceType::TraceBin, "trace_bin"),
+	resource_type_name(ResourceType::TraceCache, "trace_cache"),
+	resource_type_name(ResourceType::MemHist, "memory_history"),
+	resource_type_name(ResourceType::Strings, "strings"),
+	resource_type_name(ResourceType::StackEvents, "stack_events"),
+	resource_type_name(ResourceType::BinaryRanges, "binary_ranges"),
+	resource_type_name(ResourceType::PCRanges, "pc_ranges"),
+	resource_type_name(ResourceType::KernelDescription, "kernel_description"),
+	resource_type_name(ResourceType::Block, "block"),
+	resource_type_name(ResourceType::OssiRanges, "ossi_ranges"),
+};
+
+constexpr std::size_t resource_type_count = sizeof(resource_type_names) / sizeof(resource_type_names[0]);
+
+constexpr std::uint32_t raw_type(ResourceType type) {
+	return static_cast<std::uint32_t>(type);
+}
+
+constexpr bool resource_type_names_are_consecutive() {
+	for (std::size_t i = 0; i < resource_type_count; ++i) {
+		if (raw_type(resource_type_names[i].type) != raw_type(ResourceType::_MinValue) + i) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(raw_type(ResourceType::_MinValue) == raw_type(resource_type_names[0].type),
+              "ResourceType::_MinValue must be the value of the first resource type");
+static_assert(raw_type(ResourceType::_MaxValue) == raw_type(resource_type_names[resource_type_count - 1].type),
+              "ResourceType::_MaxValue must be the value of the last resource type");
+static_assert(resource_type_names_are_consecutive(),
+              "The resource types must be registered in ascending order and have consecutive values");
+static_assert(raw_type(ResourceType::_MaxValue) - raw_type(ResourceType::_MinValue) + 1 == resource_type_count,
+              "Every resource type must be registered");
+
+// Perfect hash of the names: their size and first char are enough to tell them apart
+constexpr std::size_t name_table_size = 32;
+constexpr std::uint8_t no_resource_type = 0xff;
+
+constexpr std::size_t name_hash(const char* name, std::size_t size) {
+	return (static_cast<unsigned char>(name[0]) + 2 * size) % name_table_size;
+}
+
+struct ResourceTypeNameTable {
+	// Index in resource_type_names of the name with each hash, no_resource_type if there is none
+	std::uint8_t indices[name_table_size];
+	bool has_collision;
+};
+
+constexpr ResourceTypeNameTable make_name_table() {
+	ResourceTypeNameTable table{{}, false};
+	for (std::size_t i = 0; i < name_table_size; ++i) {
+		table.indices[i] = no_resource_type;
 	}
 
-	check_custom_metadata(custom_metadata);
+	for (std::size_t i = 0; i < resource_type_count; ++i) {
+		const auto hash = name_hash(resource_type_names[i].name, resource_type_names[i].size);
+		if (table.indices[hash] != no_resource_type) {
+			table.has_collision = true;
+		}
+		table.indices[hash] = static_cast<std::uint8_t>(i);
+	}
+	return table;
 }
 
+constexpr ResourceTypeNameTable name_table = make_name_table();
+
+static_assert(resource_type_count < no_resource_type, "Too many resource types for the name table");
+static_assert(!name_table.has_collision, "Two resource type names have the same hash: update name_hash");
+
+} // anonymous namespace
+
 std::experimental::string_view to_string(const ResourceType type)
 {
-	switch (type) {
-		case ResourceType::TraceBin:
-			return "trace_bin";
-		case ResourceType::TraceCache:
-			return "trace_cache";
-		case ResourceType::MemHist:
-			return "memory_history";
-		case ResourceType::Strings:
-			return "strings";
-		case ResourceType::StackEvents:
-			return "stack_events";
-		case ResourceType::BinaryRanges:
-			return "binary_ranges";
-		case ResourceType::PCRanges:
-			return "pc_ranges";
-		case ResourceType::KernelDescription:
-			return "kernel_description";
-		case ResourceType::Block:
-			return "block";
-		case ResourceType::OssiRanges:
-			return "ossi_ranges";
-	}
-	throw UnknownResourceError(
-			("Resource type with value " + std::to_string(static_cast<std::uint32_t>(type)) + " is not known").c_str());
+	const auto index = raw_type(type) - raw_type(ResourceType::_MinValue);
+	if (type < ResourceType::_MinValue || index >= resource_type_count) {
+		throw UnknownResourceError(
+				("Resource type with value " + std::to_string(raw_type(type)) + " is not known").c_str());
+	}
+
+	const auto& entry = resource_type_names[index];
+	return {entry.name, entry.size};
 }
 
 ResourceType to_resource_type(std::experimental::string_view resource_name)
 {
-	if (resource_name == "trace_bin") {
-		return ResourceType::TraceBin;
-	} else if (resource_name == "trace_cache") {
-		return ResourceType::TraceCache;
-	} else if (resource_name == "memory_history") {
-		return ResourceType::MemHist;
-	} else if (resource_name == "strings") {
-		return ResourceType::Strings;
-	} else if (resource_name == "stack_events") {
-		return ResourceType::StackEvents;
-	} else if (resource_name == "binary_ranges") {
-		return ResourceType::BinaryRanges;
-	} else if (resource_name == "pc_ranges") {
-		return ResourceType::PCRanges;
-	} else if (resource_name == "kernel_description") {
-		return ResourceType::KernelDescription;
-	} else if (resource_name == "block") {
-		return ResourceType::Block;
-	} else if (resource_name == "ossi_ranges") {
-		return ResourceType::OssiRanges;
+	if (!resource_name.empty()) {
+		const auto index = name_table.indices[name_hash(resource_name.data(), resource_name.size())];
+		if (index != no_resource_type && resource_name == std::experimental::string_view(
+				resource_type_names[index].name, resource_type_names[index].size)) {
+			return resource_type_names[index].type;
+		}
 	}
 	throw UnknownResourceError(("Resource type named " + resource_name.to_string() + " is not known").c_str());
 }
 
+std::string to_date_string(std::chrono::system_clock::time_point date)
+{
+	const auto time = std::chrono::system_clock::to_time_t(date);
+	std::tm tm;
+	char buffer[24];
+	if (::gmtime_r(&time, &tm) == nullptr || std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%TZ", &tm) == 0) {
+		return std::to_string(time);
+	}
+	return buffer;
+}
+
 }} // namespace reven::metadata
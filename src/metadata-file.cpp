@@ -1,8 +1,13 @@
 #include "metadata-file.h"
 
-extern "C" {
-#include <magic.h>
-}
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <boost/filesystem.hpp>
 
@@ -13,8 +18,15 @@ extern "C" {
 #include <rvnbinresource/reader.h>
 
 #include "metadata-bin.h"
+#include "metadata-bin-header.h"
+#include "metadata-cache.h"
 #include "metadata-json.h"
+#include "metadata-json-stream.h"
+#include "metadata-magic.h"
+#include "metadata-probes.h"
 #include "metadata-sql.h"
+#include "metadata-sql-reader.h"
+#include "metadata-stats-recorder.h"
 
 namespace reven {
 namespace metadata {
@@ -27,25 +39,89 @@ enum class FormatType : std::uint8_t {
 	Json,
 };
 
-FormatType get_resource_format_type(const char* filename) {
-	std::string magic_full = [filename]() {
-		magic_t magic_cookie = magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK);
+const char* format_name(FormatType format_type) {
+	switch (format_type) {
+		case FormatType::Sqlite: return "sqlite";
+		case FormatType::Binary: return "binary";
+		case FormatType::Json: return "json";
+	}
+	return "";
+}
 
-		if (magic_cookie == nullptr) {
-			throw ReadMetadataError("Unable to initialize the magic library");
-		}
+// Header of every sqlite 3 database
+constexpr char sqlite_header[] = "SQLite format 3";
+// The header of binary resources is read while sniffing, so their metadata can be decoded without reading again
+constexpr std::size_t sniff_size = 4096;
+static_assert(sniff_size >= binheader::header_size, "The sniffed bytes must contain the binary header");
 
-		if (magic_load(magic_cookie, nullptr) != 0) {
-			magic_close(magic_cookie);
-			throw ReadMetadataError(("Cannot load magic database: " + std::string(magic_error(magic_cookie))).c_str());
-		}
+///
+/// First bytes of a resource, read while identifying its format
+///
+struct ResourceHeader {
+	char data[sniff_size];
+	std::size_t size = 0;
+};
 
-		std::string magic_full = magic_file(magic_cookie, filename);
-		magic_close(magic_cookie);
-		return magic_full;
-	}();
+///
+/// Identify the format of a resource from its first bytes, without libmagic
+/// Return false when the header is not enough to decide, e.g. the file can't be read or doesn't start with a known
+/// magic. The caller must then fall back to libmagic.
+///
+bool sniff_resource_format_type(const char* filename, FormatType& format_type, ResourceHeader& resource_header) {
+	const int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	char* header = resource_header.data;
+	const ssize_t read_size = ::pread(fd, header, sizeof(resource_header.data), 0);
+	::close(fd);
+
+	if (read_size <= 0) {
+		return false;
+	}
+
+	const auto size = static_cast<std::size_t>(read_size);
+	resource_header.size = size;
+
+	// The sizeof of the string literals include the trailing '\0', which is part of the sqlite header
+	if (size >= sizeof(sqlite_header) && std::memcmp(header, sqlite_header, sizeof(sqlite_header)) == 0) {
+		format_type = FormatType::Sqlite;
+		return true;
+	}
+
+	if (size >= sizeof(binheader::magic) - 1 &&
+	    (std::memcmp(header, binheader::magic, sizeof(binheader::magic) - 1) == 0 ||
+	     std::memcmp(header, binheader::legacy_magic, sizeof(binheader::legacy_magic) - 1) == 0)) {
+		format_type = FormatType::Binary;
+		return true;
+	}
+
+	// Like with libmagic, a text file is only considered as JSON if it has the .json extension
+	const auto first_char = std::find_if(header, header + size, [](char c) {
+		return c != ' ' && c != '\t' && c != '\n' && c != '\r';
+	});
+	if (first_char != header + size && *first_char == '{' && boost::filesystem::path(filename).extension() == ".json") {
+		format_type = FormatType::Json;
+		return true;
+	}
+
+	return false;
+}
 
-	if (magic_full == "application/x-sqlite3") {
+///
+/// Identify the format of a resource from its first bytes, or with libmagic when they are not enough
+///
+FormatType detect_resource_format_type(const char* filename, ResourceHeader& header) {
+	FormatType format_type;
+	if (sniff_resource_format_type(filename, format_type, header)) {
+		return format_type;
+	}
+
+	const std::string magic_full = MagicDetector::instance().mime_type(filename);
+
+	// Recent versions of libmagic report sqlite databases as "application/vnd.sqlite3"
+	if (magic_full == "application/x-sqlite3" || magic_full == "application/vnd.sqlite3") {
 		return FormatType::Sqlite;
 	} else if (magic_full == "application/octet-stream") {
 		return FormatType::Binary;
@@ -62,83 +138,482 @@ FormatType get_resource_format_type(const char* filename) {
 	                            + " \"" + magic_full + "\".").c_str());
 }
 
+FormatType get_resource_format_type(const char* filename, ResourceHeader& header) {
+	stats::StageTimer timer(Stage::Detect);
+	RVNMETADATA_PROBE(detect__start, filename);
+	const auto format_type = detect_resource_format_type(filename, header);
+	RVNMETADATA_PROBE(detect__done, filename, format_name(format_type), header.size);
+	return format_type;
+}
 
-} // anonymous namespace
+FormatType get_resource_format_type(const char* filename) {
+	ResourceHeader header;
+	return get_resource_format_type(filename, header);
+}
 
-Metadata from_resource(const char* filename) {
-	auto format_type = get_resource_format_type(filename);
+///
+/// Open a resource with the library of its format, returning what `open` returns
+///
+template <typename Open>
+auto open_backend(const char* filename, FormatType format_type, bool write, Open&& open) -> decltype(open()) {
+	RVNMETADATA_PROBE(open__start, filename, format_name(format_type), static_cast<int>(write));
+	auto backend = stats::timed(Stage::Open, std::forward<Open>(open));
+	RVNMETADATA_PROBE(open__done, filename, format_name(format_type), static_cast<int>(write));
+	return backend;
+}
 
-	switch (format_type) {
-		case FormatType::Sqlite:
-			try {
-				auto rdb = reven::sqlite::ResourceDatabase::open(filename);
-				return from_raw_metadata(rdb.metadata());
-			} catch(const reven::sqlite::MetadataError& e) {
-				throw ReadMetadataError(e.what());
-			} catch(const reven::sqlite::DatabaseError& e) {
-				throw ReadMetadataError(e.what());
-			}
-		case FormatType::Binary:
-			try {
-				const auto bin_reader = reven::binresource::Reader::open(filename);
-				return from_raw_metadata(bin_reader.metadata());
-			} catch (const reven::binresource::ReaderError& e) {
-				throw ReadMetadataError(e.what());
-			}
-			break;
-		case FormatType::Json:
-			try {
-				const auto json_reader = reven::jsonresource::Reader::open(filename);
-				return from_raw_metadata(json_reader.metadata());
-			} catch (const reven::jsonresource::MetadataError& e) {
-				throw ReadMetadataError(e.what());
-			} catch (const reven::jsonresource::ReaderError& e) {
-				throw ReadMetadataError(e.what());
-			}
-			break;
-	};
+///
+/// Fire the close probe on destruction
+/// Declared right after opening a resource, so it is destroyed, and the probe fired, before the object of the library.
+///
+class CloseProbe {
+public:
+	CloseProbe(const char* filename, FormatType format_type)
+		: filename_(filename)
+		, format_type_(format_type)
+	{
+	}
+
+	~CloseProbe() {
+		RVNMETADATA_PROBE(close, filename_, format_name(format_type_));
+	}
+
+	CloseProbe(const CloseProbe&) = delete;
+	CloseProbe& operator=(const CloseProbe&) = delete;
+
+private:
+	const char* filename_;
+	FormatType format_type_;
+};
+
+///
+/// Fire the read-done probe, then call `fn` with the view over the metadata read from the resource
+/// `bytes_read` is the number of bytes the metadata were read from, 0 when the library of the format read them.
+///
+template <typename Fn>
+auto call_with_view(const char* filename, FormatType format_type, const MetadataView& view, std::size_t bytes_read,
+                    Fn&& fn) -> decltype(fn(view)) {
+	RVNMETADATA_PROBE(read__done, filename, format_name(format_type), bytes_read);
+	return fn(view);
+}
+
+///
+/// Call `fn` with a view over the metadata of a sqlite resource, returning what `fn` returns
+///
+template <typename Fn>
+auto with_sqlite_view(const char* filename, MetadataFields fields, Fn&& fn)
+	-> decltype(fn(std::declval<const MetadataView&>())) {
+	RVNMETADATA_PROBE(read__start, filename, format_name(FormatType::Sqlite));
+
+	// The resources are not modified while read: no need for locks nor journal
+	sqlreader::SqlMetadata sql_md;
+	if (stats::timed(Stage::ReadRaw, [&] { return sqlreader::read(filename, fields, sql_md); })) {
+		return call_with_view(filename, FormatType::Sqlite, sql_md.view(), sql_md.bytes_read, fn);
+	}
+
+	stats::record_fallback();
+	try {
+		auto rdb = open_backend(filename, FormatType::Sqlite, false, [&] {
+			return reven::sqlite::ResourceDatabase::open(filename);
+		});
+		CloseProbe close_probe(filename, FormatType::Sqlite);
+		return call_with_view(filename, FormatType::Sqlite, stats::timed(Stage::ReadRaw, [&] {
+			return view_raw_metadata(rdb.metadata());
+		}), 0, fn);
+	} catch(const reven::sqlite::MetadataError& e) {
+		throw ReadMetadataError(e.what());
+	} catch(const reven::sqlite::DatabaseError& e) {
+		throw ReadMetadataError(e.what());
+	}
+}
+
+///
+/// Call `fn` with a view over the metadata of a binary resource, returning what `fn` returns
+///
+template <typename Fn>
+auto with_binary_view(const char* filename, const ResourceHeader& header, Fn&& fn)
+	-> decltype(fn(std::declval<const MetadataView&>())) {
+	RVNMETADATA_PROBE(read__start, filename, format_name(FormatType::Binary));
+
+	// The metadata are in the header read while sniffing: no need to set up a reader over the whole file
+	std::size_t header_bytes = 0;
+	const auto view = stats::timed(Stage::ReadRaw, [&] {
+		return binheader::view(header.data, header.size, header_bytes);
+	});
+	if (view) {
+		return call_with_view(filename, FormatType::Binary, *view, header_bytes, fn);
+	}
+
+	stats::record_fallback();
+	try {
+		const auto bin_reader = open_backend(filename, FormatType::Binary, false, [&] {
+			return reven::binresource::Reader::open(filename);
+		});
+		CloseProbe close_probe(filename, FormatType::Binary);
+		return call_with_view(filename, FormatType::Binary, stats::timed(Stage::ReadRaw, [&] {
+			return view_raw_metadata(bin_reader.metadata());
+		}), 0, fn);
+	} catch (const reven::binresource::ReaderError& e) {
+		throw ReadMetadataError(e.what());
+	}
+}
+
+///
+/// Call `fn` with a view over the metadata of a JSON resource, returning what `fn` returns
+///
+template <typename Fn>
+auto with_json_view(const char* filename, const ResourceHeader& header, MetadataFields fields, Fn&& fn)
+	-> decltype(fn(std::declval<const MetadataView&>())) {
+	RVNMETADATA_PROBE(read__start, filename, format_name(FormatType::Json));
+
+	// Tokenize the document without building it, the first bytes of which have already been read
+	jsonstream::JsonMetadata json_md;
+	const bool extracted = stats::timed(Stage::ReadRaw, [&] {
+		return jsonstream::extract(filename, header.data, header.size, fields, json_md);
+	});
+	if (extracted) {
+		return call_with_view(filename, FormatType::Json, json_md.view(), json_md.bytes_read, fn);
+	}
+
+	stats::record_fallback();
+	try {
+		const auto json_reader = open_backend(filename, FormatType::Json, false, [&] {
+			return reven::jsonresource::Reader::open(filename);
+		});
+		CloseProbe close_probe(filename, FormatType::Json);
+		return call_with_view(filename, FormatType::Json, stats::timed(Stage::ReadRaw, [&] {
+			return view_raw_metadata(json_reader.metadata());
+		}), 0, fn);
+	} catch (const reven::jsonresource::MetadataError& e) {
+		throw ReadMetadataError(e.what());
+	} catch (const reven::jsonresource::ReaderError& e) {
+		throw ReadMetadataError(e.what());
+	}
+}
+
+///
+/// Open the resource and call `fn` with a view over its raw metadata, returning what `fn` returns
+/// The view is only valid during the call. It contains at least the requested `fields`.
+///
+template <typename Fn>
+auto with_resource_view(const char* filename, MetadataFields fields, Fn&& fn)
+	-> decltype(fn(std::declval<const MetadataView&>())) {
+	try {
+		ResourceHeader header;
+		auto format_type = get_resource_format_type(filename, header);
+
+		switch (format_type) {
+			case FormatType::Sqlite:
+				return with_sqlite_view(filename, fields, std::forward<Fn>(fn));
+			case FormatType::Binary:
+				return with_binary_view(filename, header, std::forward<Fn>(fn));
+			case FormatType::Json:
+				return with_json_view(filename, header, fields, std::forward<Fn>(fn));
+		};
+	} catch (const std::exception& e) {
+		RVNMETADATA_PROBE(error, filename, e.what());
+		throw;
+	}
 
 	throw std::logic_error("Unreachable code");
 }
 
-void set_metadata(const char* filename, const Metadata& md) {
-	auto format_type = get_resource_format_type(filename);
+// Construct the metadata from a view, recording it as the convert stage
+Metadata to_timed_metadata(const MetadataView& view) {
+	stats::StageTimer timer(Stage::Convert);
+	return view.to_metadata();
+}
 
-	switch (format_type) {
-		case FormatType::Sqlite:
-			try {
-				auto rdb = reven::sqlite::ResourceDatabase::open(filename, false);
-				rdb.set_metadata(to_sqlite_raw_metadata(md));
-				return;
-			} catch(const reven::sqlite::MetadataError& e) {
-				throw WriteMetadataError(e.what());
-			} catch(const reven::sqlite::DatabaseError& e) {
-				throw WriteMetadataError(e.what());
-			}
-		case FormatType::Binary:
-			try {
-				auto bin_writer = reven::binresource::Writer::open(filename);
-				bin_writer.set_metadata(to_bin_raw_metadata(md));
-				return;
-			} catch (const reven::binresource::WriterError& e) {
-				throw WriteMetadataError(e.what());
+///
+/// Convert the metadata to the raw metadata of a format and write them with `writer`
+///
+template <typename Writer, typename ToRawMetadata>
+void write_raw_metadata(const char* filename, FormatType format_type, Writer& writer, const Metadata& md,
+                        ToRawMetadata to_raw_metadata) {
+	RVNMETADATA_PROBE(write__start, filename, format_name(format_type));
+	const auto raw_md = stats::timed(Stage::Convert, [&] { return to_raw_metadata(md); });
+	stats::timed(Stage::Write, [&] { writer.set_metadata(raw_md); });
+	RVNMETADATA_PROBE(write__done, filename, format_name(format_type));
+}
+
+Metadata read_resource(const char* filename) {
+	return with_resource_view(filename, MetadataFields::All, to_timed_metadata);
+}
+
+void write_resource(const char* filename, const Metadata& md) {
+	try {
+		auto format_type = get_resource_format_type(filename);
+
+		switch (format_type) {
+			case FormatType::Sqlite:
+				try {
+					auto rdb = open_backend(filename, FormatType::Sqlite, true, [&] {
+						return reven::sqlite::ResourceDatabase::open(filename, false);
+					});
+					CloseProbe close_probe(filename, FormatType::Sqlite);
+					write_raw_metadata(filename, FormatType::Sqlite, rdb, md, to_sqlite_raw_metadata);
+					return;
+				} catch(const reven::sqlite::MetadataError& e) {
+					throw WriteMetadataError(e.what());
+				} catch(const reven::sqlite::DatabaseError& e) {
+					throw WriteMetadataError(e.what());
+				}
+			case FormatType::Binary:
+				try {
+					auto bin_writer = open_backend(filename, FormatType::Binary, true, [&] {
+						return reven::binresource::Writer::open(filename);
+					});
+					CloseProbe close_probe(filename, FormatType::Binary);
+					write_raw_metadata(filename, FormatType::Binary, bin_writer, md, to_bin_raw_metadata);
+					return;
+				} catch (const reven::binresource::WriterError& e) {
+					throw WriteMetadataError(e.what());
+				}
+				break;
+			case FormatType::Json:
+				try {
+					auto json_writer = open_backend(filename, FormatType::Json, true, [&] {
+						return reven::jsonresource::Writer::open(filename);
+					});
+					CloseProbe close_probe(filename, FormatType::Json);
+					write_raw_metadata(filename, FormatType::Json, json_writer, md, to_json_raw_metadata);
+					return;
+				} catch (const reven::jsonresource::MetadataError& e) {
+					throw WriteMetadataError(e.what());
+				} catch (const reven::jsonresource::WriterError& e) {
+					throw WriteMetadataError(e.what());
+				}
+				break;
+		};
+	} catch (const std::exception& e) {
+		RVNMETADATA_PROBE(error, filename, e.what());
+		throw;
+	}
+
+	throw std::logic_error("Unreachable code");
+}
+
+///
+/// Read the metadata of a sqlite resource, pass them to `fn` and write the metadata it returns with the same connection
+/// Return the written metadata.
+///
+Metadata modify_sqlite_resource(const char* filename, const std::function<Metadata(Metadata)>& fn) {
+	boost::optional<reven::sqlite::ResourceDatabase> rdb;
+	std::string open_error;
+	try {
+		rdb.emplace(open_backend(filename, FormatType::Sqlite, true, [&] {
+			return reven::sqlite::ResourceDatabase::open(filename, false);
+		}));
+	} catch(const reven::sqlite::MetadataError& e) {
+		open_error = e.what();
+	} catch(const reven::sqlite::DatabaseError& e) {
+		open_error = e.what();
+	}
+
+	if (!rdb) {
+		// The resource may be readable but not writable, e.g. if its metadata are outdated. Report the errors of
+		// from_resource first, as with the other formats.
+		with_sqlite_view(filename, MetadataFields::All, [](const MetadataView&) {});
+		throw WriteMetadataError(open_error.c_str());
+	}
+
+	CloseProbe close_probe(filename, FormatType::Sqlite);
+
+	RVNMETADATA_PROBE(read__start, filename, format_name(FormatType::Sqlite));
+	auto md = [&] {
+		try {
+			return call_with_view(filename, FormatType::Sqlite, stats::timed(Stage::ReadRaw, [&] {
+				return view_raw_metadata(rdb->metadata());
+			}), 0, to_timed_metadata);
+		} catch(const reven::sqlite::MetadataError& e) {
+			throw ReadMetadataError(e.what());
+		} catch(const reven::sqlite::DatabaseError& e) {
+			throw ReadMetadataError(e.what());
+		}
+	}();
+
+	md = fn(std::move(md));
+
+	try {
+		write_raw_metadata(filename, FormatType::Sqlite, *rdb, md, to_sqlite_raw_metadata);
+		return md;
+	} catch(const reven::sqlite::MetadataError& e) {
+		throw WriteMetadataError(e.what());
+	} catch(const reven::sqlite::DatabaseError& e) {
+		throw WriteMetadataError(e.what());
+	}
+}
+
+///
+/// Read the metadata of the resource, pass them to `fn` and write the metadata it returns, detecting the format once
+/// Return the written metadata.
+///
+Metadata modify_resource(const char* filename, const std::function<Metadata(Metadata)>& fn) {
+	try {
+		ResourceHeader header;
+		auto format_type = get_resource_format_type(filename, header);
+
+		switch (format_type) {
+			case FormatType::Sqlite:
+				return modify_sqlite_resource(filename, fn);
+			// The writers of these formats don't give access to the metadata: they are read before opening the
+			// resource for writing, from the header read while detecting the format or with the streaming parser
+			case FormatType::Binary: {
+				auto md = fn(with_binary_view(filename, header, to_timed_metadata));
+				try {
+					auto bin_writer = open_backend(filename, FormatType::Binary, true, [&] {
+						return reven::binresource::Writer::open(filename);
+					});
+					CloseProbe close_probe(filename, FormatType::Binary);
+					write_raw_metadata(filename, FormatType::Binary, bin_writer, md, to_bin_raw_metadata);
+					return md;
+				} catch (const reven::binresource::WriterError& e) {
+					throw WriteMetadataError(e.what());
+				}
+				break;
 			}
-			break;
-		case FormatType::Json:
-			try {
-				auto json_writer = reven::jsonresource::Writer::open(filename);
-				json_writer.set_metadata(to_json_raw_metadata(md));
-				return;
-			} catch (const reven::jsonresource::MetadataError& e) {
-				throw WriteMetadataError(e.what());
-			} catch (const reven::jsonresource::WriterError& e) {
-				throw WriteMetadataError(e.what());
+			case FormatType::Json: {
+				auto md = fn(with_json_view(filename, header, MetadataFields::All, to_timed_metadata));
+				try {
+					auto json_writer = open_backend(filename, FormatType::Json, true, [&] {
+						return reven::jsonresource::Writer::open(filename);
+					});
+					CloseProbe close_probe(filename, FormatType::Json);
+					write_raw_metadata(filename, FormatType::Json, json_writer, md, to_json_raw_metadata);
+					return md;
+				} catch (const reven::jsonresource::MetadataError& e) {
+					throw WriteMetadataError(e.what());
+				} catch (const reven::jsonresource::WriterError& e) {
+					throw WriteMetadataError(e.what());
+				}
+				break;
 			}
-			break;
-	};
+		};
+	} catch (const std::exception& e) {
+		RVNMETADATA_PROBE(error, filename, e.what());
+		throw;
+	}
 
 	throw std::logic_error("Unreachable code");
 }
 
+///
+/// Call `fn(i)` for each i in [0, count) on a pool of at most `thread_count` threads (0 for one per core)
+/// `fn` must not throw.
+///
+template <typename Fn>
+void parallel_for(std::size_t count, unsigned thread_count, Fn fn) {
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	const auto worker_count = static_cast<unsigned>(std::min<std::size_t>(thread_count, count));
+
+	std::atomic<std::size_t> next_index{0};
+	auto worker = [&]() {
+		for (std::size_t i = next_index++; i < count; i = next_index++) {
+			fn(i);
+		}
+	};
+
+	if (worker_count <= 1) {
+		worker();
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(worker_count - 1);
+
+	try {
+		for (unsigned i = 0; i < worker_count - 1; ++i) {
+			threads.emplace_back(worker);
+		}
+	} catch (...) {
+		// Not able to start all the threads: the current one and the already started ones will do the work
+	}
+
+	worker();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+} // anonymous namespace
+
+Metadata from_resource(const char* filename) {
+	auto cache = process_metadata_cache();
+	if (cache == nullptr) {
+		return read_resource(filename);
+	}
+
+	return cache->get(filename, read_resource);
+}
+
+void view_resource(const char* filename, const std::function<void(const MetadataView&)>& visitor) {
+	with_resource_view(filename, MetadataFields::All, visitor);
+}
+
+void view_resource(const char* filename, MetadataFields fields,
+                   const std::function<void(const MetadataView&)>& visitor) {
+	with_resource_view(filename, fields, visitor);
+}
+
+std::vector<ResourceMetadataResult> from_resources(const std::vector<std::string>& filenames,
+                                                   unsigned thread_count) {
+	std::vector<boost::optional<ResourceMetadataResult>> results(filenames.size());
+
+	parallel_for(filenames.size(), thread_count, [&](std::size_t i) {
+		try {
+			results[i].emplace(from_resource(filenames[i].c_str()));
+		} catch (...) {
+			results[i].emplace(std::current_exception());
+		}
+	});
+
+	std::vector<ResourceMetadataResult> output;
+	output.reserve(results.size());
+	for (auto& result : results) {
+		output.push_back(std::move(*result));
+	}
+
+	return output;
+}
+
+void set_metadata(const char* filename, const Metadata& md) {
+	auto cache = process_metadata_cache();
+	if (cache == nullptr) {
+		write_resource(filename, md);
+		return;
+	}
+
+	try {
+		write_resource(filename, md);
+	} catch (...) {
+		cache->invalidate(filename);
+		throw;
+	}
+
+	// So this process always sees its own writes, even if the size and the modification time didn't change
+	cache->update(filename, md);
+}
+
+void update_metadata(const char* filename, const std::function<Metadata(Metadata)>& fn) {
+	auto cache = process_metadata_cache();
+	if (cache == nullptr) {
+		modify_resource(filename, fn);
+		return;
+	}
+
+	try {
+		const auto md = modify_resource(filename, fn);
+
+		// So this process always sees its own writes, even if the size and the modification time didn't change
+		cache->update(filename, md);
+	} catch (...) {
+		cache->invalidate(filename);
+		throw;
+	}
+}
 
 }} // namespace reven::metadata
@@ -0,0 +1,565 @@
+#include "metadata-json-stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace reven {
+namespace metadata {
+namespace jsonstream {
+
+namespace {
+
+// Version of the metadata object supported by the extractor, the others are left to the jsonresource reader
+constexpr char supported_metadata_version[] = "1";
+
+// Nesting depth of the values skipped before giving up, to bound the stack usage
+constexpr unsigned max_depth = 256;
+
+constexpr int end_of_input = -1;
+
+///
+/// Bytes of a file, read in chunks and starting with the bytes that have already been read, if any
+/// A read error is handled like the end of the file, and reported by `failed`.
+///
+class Input {
+public:
+	Input(const char* filename, const char* prefix, std::size_t prefix_size)
+		: filename_(filename)
+		, pos_(prefix)
+		, end_(prefix + prefix_size)
+		, offset_(prefix_size)
+	{
+	}
+
+	~Input() {
+		if (fd_ >= 0) {
+			::close(fd_);
+		}
+	}
+
+	Input(const Input&) = delete;
+	Input& operator=(const Input&) = delete;
+
+	int peek() {
+		if (pos_ == end_ && !fill()) {
+			return end_of_input;
+		}
+		return static_cast<unsigned char>(*pos_);
+	}
+
+	int get() {
+		const int c = peek();
+		if (c != end_of_input) {
+			++pos_;
+		}
+		return c;
+	}
+
+	// Number of bytes read from the file, not counting the prefix
+	std::size_t bytes_read() const {
+		return bytes_read_;
+	}
+
+	// True if the file couldn't be opened or read, rather than ending
+	bool failed() const {
+		return failed_;
+	}
+
+private:
+	bool open() {
+		if (fd_ < 0 && !failed_) {
+			fd_ = ::open(filename_, O_RDONLY | O_CLOEXEC);
+			failed_ = fd_ < 0;
+		}
+		return fd_ >= 0;
+	}
+
+	bool fill() {
+		if (!open()) {
+			return false;
+		}
+
+		const ssize_t read_size = ::pread(fd_, buffer_, sizeof(buffer_), static_cast<off_t>(offset_));
+		if (read_size <= 0) {
+			failed_ = read_size < 0;
+			return false;
+		}
+
+		offset_ += static_cast<std::size_t>(read_size);
+		bytes_read_ += static_cast<std::size_t>(read_size);
+		pos_ = buffer_;
+		end_ = buffer_ + read_size;
+		return true;
+	}
+
+	const char* filename_;
+	int fd_ = -1;
+	bool failed_ = false;
+
+	const char* pos_;
+	const char* end_;
+	std::size_t offset_;
+	std::size_t bytes_read_ = 0;
+
+	char buffer_[4096];
+};
+
+bool is_digit(int c) {
+	return c >= '0' && c <= '9';
+}
+
+int hex_value(int c) {
+	if (is_digit(c)) {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+void append_utf8(std::string& out, std::uint32_t code_point) {
+	if (code_point < 0x80) {
+		out += static_cast<char>(code_point);
+	} else if (code_point < 0x800) {
+		out += static_cast<char>(0xc0 | (code_point >> 6));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	} else if (code_point < 0x10000) {
+		out += static_cast<char>(0xe0 | (code_point >> 12));
+		out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	} else {
+		out += static_cast<char>(0xf0 | (code_point >> 18));
+		out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+		out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	}
+}
+
+// Parse a decimal integer without sign nor leading whitespace, as stored in the metadata object
+template <typename T>
+bool parse_integer(const std::string& str, T& value) {
+	if (str.empty()) {
+		return false;
+	}
+
+	std::uint64_t result = 0;
+	for (char c : str) {
+		if (!is_digit(c)) {
+			return false;
+		}
+
+		const auto digit = static_cast<std::uint64_t>(c - '0');
+		if (result > (std::numeric_limits<T>::max() - digit) / 10) {
+			return false;
+		}
+		result = result * 10 + digit;
+	}
+
+	value = static_cast<T>(result);
+	return true;
+}
+
+///
+/// Pull parser over the input, which only keeps the strings it is asked for
+/// Every method returns false if the input is not what is expected.
+///
+class Parser {
+public:
+	explicit Parser(Input& input) : input_(input) {}
+
+	int peek_token() {
+		int c = input_.peek();
+		while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			input_.get();
+			c = input_.peek();
+		}
+		return c;
+	}
+
+	bool expect(char expected) {
+		return peek_token() == expected && input_.get() == expected;
+	}
+
+	// Parse a string, or skip it if `out` is null
+	bool parse_string(std::string* out) {
+		if (!expect('"')) {
+			return false;
+		}
+
+		while (true) {
+			const int c = input_.get();
+			if (c == '"') {
+				return true;
+			} else if (c == end_of_input || c < 0x20) {
+				return false;
+			} else if (c != '\\') {
+				if (out) {
+					*out += static_cast<char>(c);
+				}
+				if (c >= 0x80 && !parse_utf8_sequence(c, out)) {
+					return false;
+				}
+				continue;
+			}
+
+			const int escaped = input_.get();
+			char unescaped;
+			switch (escaped) {
+				case '"': unescaped = '"'; break;
+				case '\\': unescaped = '\\'; break;
+				case '/': unescaped = '/'; break;
+				case 'b': unescaped = '\b'; break;
+				case 'f': unescaped = '\f'; break;
+				case 'n': unescaped = '\n'; break;
+				case 'r': unescaped = '\r'; break;
+				case 't': unescaped = '\t'; break;
+				case 'u': {
+					std::uint32_t code_point;
+					if (!parse_unicode_escape(code_point)) {
+						return false;
+					}
+					if (out) {
+						append_utf8(*out, code_point);
+					}
+					continue;
+				}
+				default:
+					return false;
+			}
+
+			if (out) {
+				*out += unescaped;
+			}
+		}
+	}
+
+	bool skip_value(unsigned depth = 0) {
+		if (depth > max_depth) {
+			return false;
+		}
+
+		switch (peek_token()) {
+			case '"':
+				return parse_string(nullptr);
+			case '{':
+				input_.get();
+				if (peek_token() == '}') {
+					input_.get();
+					return true;
+				}
+				do {
+					if (!parse_string(nullptr) || !expect(':') || !skip_value(depth + 1)) {
+						return false;
+					}
+				} while (next_member());
+				return expect('}');
+			case '[':
+				input_.get();
+				if (peek_token() == ']') {
+					input_.get();
+					return true;
+				}
+				do {
+					if (!skip_value(depth + 1)) {
+						return false;
+					}
+				} while (next_member());
+				return expect(']');
+			case 't':
+				return skip_literal("true");
+			case 'f':
+				return skip_literal("false");
+			case 'n':
+				return skip_literal("null");
+			default:
+				return skip_number();
+		}
+	}
+
+	// Consume the ',' between two members or elements, false if there is none
+	bool next_member() {
+		if (peek_token() == ',') {
+			input_.get();
+			return true;
+		}
+		return false;
+	}
+
+private:
+	// Parse the continuation bytes of the UTF-8 sequence starting with `lead`, rejecting the invalid sequences
+	bool parse_utf8_sequence(int lead, std::string* out) {
+		unsigned count;
+		std::uint32_t code_point;
+		std::uint32_t min_code_point;
+		if ((lead & 0xe0) == 0xc0) {
+			count = 1;
+			code_point = static_cast<std::uint32_t>(lead & 0x1f);
+			min_code_point = 0x80;
+		} else if ((lead & 0xf0) == 0xe0) {
+			count = 2;
+			code_point = static_cast<std::uint32_t>(lead & 0x0f);
+			min_code_point = 0x800;
+		} else if ((lead & 0xf8) == 0xf0) {
+			count = 3;
+			code_point = static_cast<std::uint32_t>(lead & 0x07);
+			min_code_point = 0x10000;
+		} else {
+			return false;
+		}
+
+		for (unsigned i = 0; i < count; ++i) {
+			const int c = input_.get();
+			if (c == end_of_input || (c & 0xc0) != 0x80) {
+				return false;
+			}
+			code_point = (code_point << 6) | static_cast<std::uint32_t>(c & 0x3f);
+			if (out) {
+				*out += static_cast<char>(c);
+			}
+		}
+
+		// Overlong encodings, surrogates and code points out of the Unicode range
+		return code_point >= min_code_point && code_point <= 0x10ffff && (code_point < 0xd800 || code_point > 0xdfff);
+	}
+
+	bool parse_hex4(std::uint32_t& value) {
+		value = 0;
+		for (int i = 0; i < 4; ++i) {
+			const int digit = hex_value(input_.get());
+			if (digit < 0) {
+				return false;
+			}
+			value = value * 16 + static_cast<std::uint32_t>(digit);
+		}
+		return true;
+	}
+
+	// Parse the XXXX of a \uXXXX escape, and of the low surrogate that follows a high one
+	bool parse_unicode_escape(std::uint32_t& code_point) {
+		if (!parse_hex4(code_point)) {
+			return false;
+		}
+
+		if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+			return false;
+		} else if (code_point < 0xd800 || code_point > 0xdbff) {
+			return true;
+		}
+
+		std::uint32_t low;
+		if (input_.get() != '\\' || input_.get() != 'u' || !parse_hex4(low) || low < 0xdc00 || low > 0xdfff) {
+			return false;
+		}
+
+		code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+		return true;
+	}
+
+	bool skip_literal(const char* literal) {
+		for (; *literal != '\0'; ++literal) {
+			if (input_.get() != *literal) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool skip_digits() {
+		if (!is_digit(input_.peek())) {
+			return false;
+		}
+		while (is_digit(input_.peek())) {
+			input_.get();
+		}
+		return true;
+	}
+
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	bool skip_number() {
+		if (input_.peek() == '-') {
+			input_.get();
+		}
+
+		if (input_.peek() == '0') {
+			input_.get();
+		} else if (!skip_digits()) {
+			return false;
+		}
+
+		if (input_.peek() == '.') {
+			input_.get();
+			if (!skip_digits()) {
+				return false;
+			}
+		}
+
+		if (input_.peek() == 'e' || input_.peek() == 'E') {
+			input_.get();
+			if (input_.peek() == '+' || input_.peek() == '-') {
+				input_.get();
+			}
+			if (!skip_digits()) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	Input& input_;
+};
+
+///
+/// Fields of the metadata object
+///
+struct MetadataFieldsParser {
+	std::string metadata_version;
+	std::string type;
+	std::string generation_date;
+	JsonMetadata& md;
+
+	bool has_custom = false;
+	unsigned seen = 0;
+
+	// Return the string a field is parsed into and the bit marking it as seen, null if it is not a string field
+	std::string* string_field(const std::string& key, unsigned& bit) {
+		std::string* const fields[] = {
+			&metadata_version, &type, &md.format_version, &md.tool_name, &md.tool_version, &md.tool_info,
+			&generation_date,
+		};
+		static const char* const names[] = {
+			"metadata_version", "type", "format_version", "tool_name", "tool_version", "tool_info",
+			"generation_date",
+		};
+
+		for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+			if (key == names[i]) {
+				bit = 1u << i;
+				return fields[i];
+			}
+		}
+		return nullptr;
+	}
+
+	bool is_complete() const {
+		return seen == (1u << 7) - 1;
+	}
+};
+
+bool parse_custom_metadata(Parser& parser, JsonMetadata& md) {
+	if (!parser.expect('{')) {
+		return false;
+	}
+
+	if (parser.peek_token() != '}') {
+		do {
+			std::string key;
+			std::string value;
+			if (!parser.parse_string(&key) || !parser.expect(':') || !parser.parse_string(&value)) {
+				return false;
+			}
+			md.custom_metadata.emplace_back(std::move(key), std::move(value));
+		} while (parser.next_member());
+	}
+
+	if (!parser.expect('}')) {
+		return false;
+	}
+
+	// Which one of duplicated keys is kept is up to the jsonresource reader
+	std::vector<std::string> keys;
+	keys.reserve(md.custom_metadata.size());
+	for (const auto& custom : md.custom_metadata) {
+		keys.push_back(custom.first);
+	}
+	std::sort(keys.begin(), keys.end());
+	return std::adjacent_find(keys.begin(), keys.end()) == keys.end();
+}
+
+bool parse_metadata(Parser& parser, MetadataFields wanted, JsonMetadata& md) {
+	MetadataFieldsParser fields{{}, {}, {}, md};
+	const bool skip_custom = !has_fields(wanted, MetadataFields::Custom);
+
+	if (!parser.expect('{')) {
+		return false;
+	}
+
+	if (parser.peek_token() != '}') {
+		do {
+			std::string key;
+			if (!parser.parse_string(&key) || !parser.expect(':')) {
+				return false;
+			}
+
+			unsigned bit = 0;
+			if (auto field = fields.string_field(key, bit)) {
+				if ((fields.seen & bit) != 0 || !parser.parse_string(field)) {
+					return false;
+				}
+				fields.seen |= bit;
+			} else if (key == "custom") {
+				// Checked even when they are not requested, since the jsonresource reader would reject them
+				if (fields.has_custom || !parse_custom_metadata(parser, md)) {
+					return false;
+				}
+				fields.has_custom = true;
+			} else if (!parser.skip_value()) {
+				return false;
+			}
+		} while (parser.next_member());
+	}
+
+	if (skip_custom) {
+		md.custom_metadata.clear();
+		md.fields = ~MetadataFields::Custom;
+	}
+
+	return parser.expect('}') && fields.is_complete() && fields.metadata_version == supported_metadata_version &&
+	       parse_integer(fields.type, md.type) && parse_integer(fields.generation_date, md.generation_date);
+}
+
+} // anonymous namespace
+
+bool extract(const char* filename, const char* prefix, std::size_t prefix_size, MetadataFields fields,
+             JsonMetadata& md) {
+	Input input(filename, prefix, prefix_size);
+	Parser parser(input);
+
+	if (!parser.expect('{') || parser.peek_token() == '}') {
+		return false;
+	}
+
+	bool has_metadata = false;
+	do {
+		std::string key;
+		if (!parser.parse_string(&key) || !parser.expect(':')) {
+			return false;
+		}
+
+		if (key == "metadata") {
+			// Which one of duplicated metadata objects is used is up to the jsonresource reader
+			if (has_metadata || !parse_metadata(parser, fields, md)) {
+				return false;
+			}
+			has_metadata = true;
+		} else if (!parser.skip_value()) {
+			return false;
+		}
+	} while (parser.next_member());
+
+	// The whole document is tokenized, so that only the documents the jsonresource reader accepts are accepted
+	if (!parser.expect('}') || parser.peek_token() != end_of_input || input.failed()) {
+		return false;
+	}
+
+	md.bytes_read = input.bytes_read();
+	return has_metadata;
+}
+
+}}} // namespace reven::metadata::jsonstream
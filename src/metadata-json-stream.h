@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metadata-view.h"
+
+namespace reven {
+namespace metadata {
+namespace jsonstream {
+
+///
+/// Metadata extracted from a JSON resource, owning its strings
+///
+struct JsonMetadata {
+	std::uint32_t type = 0;
+	std::string format_version;
+	std::string tool_name;
+	std::string tool_version;
+	std::string tool_info;
+	std::uint64_t generation_date = 0;
+	std::vector<std::pair<std::string, std::string>> custom_metadata;
+	/// The fields that have been extracted
+	MetadataFields fields = MetadataFields::All;
+	/// The number of bytes read from the file, not counting the prefix
+	std::size_t bytes_read = 0;
+
+	///
+	/// \brief view get a view over these metadata, which must outlive it
+	MetadataView view() const {
+		return MetadataView(type, format_version, tool_name, tool_version, tool_info, generation_date,
+		                    custom_metadata).restrict_fields(fields);
+	}
+};
+
+///
+/// \brief extract Read the "metadata" object of a JSON resource, without building the rest of the document
+/// The whole document is tokenized, but only the metadata are kept: the memory used doesn't depend on the size of
+/// the file. The document must be strictly well-formed JSON (RFC 8259, in UTF-8) so that the documents the
+/// jsonresource reader rejects are left to it, whatever the part of the document that is ill-formed.
+/// \param filename The JSON resource
+/// \param prefix The first bytes of the file if they have already been read, to avoid reading them again
+/// \param prefix_size The number of bytes in `prefix`
+/// \param fields The fields that are needed: the custom metadata are checked but not kept if they are not
+/// \param md Set to the extracted metadata on success
+/// \return false if the metadata can't be extracted that way, e.g. the file can't be read, is ill-formed, the
+///   metadata fields are incomplete, duplicated or of an unsupported version. The jsonresource reader must then be
+///   used to get its result or error.
+bool extract(const char* filename, const char* prefix, std::size_t prefix_size, MetadataFields fields,
+             JsonMetadata& md);
+
+}}} // namespace reven::metadata::jsonstream
@@ -14,23 +14,26 @@ public:
 			static_cast<std::uint32_t>(md.type()), md.format_version().to_string(),
 			md.tool_name().to_string(), md.tool_version().to_string(), md.tool_info().to_string(),
 			static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(md.generation_date().time_since_epoch()).count()),
-			static_cast<reven::jsonresource::CustomMetadata>(md.custom_metadata())
+			reven::jsonresource::CustomMetadata(md.custom_metadata().begin(), md.custom_metadata().end())
 		);
 	}
 };
 
 } // anonymous namespace
 
-Metadata from_raw_metadata(const reven::jsonresource::Metadata& md) {
-	return Metadata(
-		static_cast<ResourceType>(md.type()),
-		Version::from_string(md.format_version()),
-		md.tool_name(), Version::from_string(md.tool_version()), md.tool_info(),
-		static_cast<CustomMetadata>(md.custom_metadata()),
-		std::chrono::system_clock::time_point{std::chrono::seconds(md.generation_date())}
+MetadataView view_raw_metadata(const reven::jsonresource::Metadata& md) {
+	return MetadataView(
+		md.type(), md.format_version(),
+		md.tool_name(), md.tool_version(), md.tool_info(),
+		md.generation_date(),
+		md.custom_metadata()
 	);
 }
 
+Metadata from_raw_metadata(const reven::jsonresource::Metadata& md) {
+	return view_raw_metadata(md).to_metadata();
+}
+
 reven::jsonresource::Metadata to_json_raw_metadata(const Metadata& md) {
 	return JsonMetadataWriter::write(md);
 }
@@ -0,0 +1,102 @@
+#include "metadata-magic.h"
+
+extern "C" {
+#include <magic.h>
+}
+
+namespace reven {
+namespace metadata {
+
+namespace {
+
+constexpr int magic_flags = MAGIC_MIME_TYPE | MAGIC_SYMLINK;
+
+std::chrono::nanoseconds elapsed_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+}
+
+} // anonymous namespace
+
+struct MagicDetector::Cookie {
+	magic_t cookie = nullptr;
+
+	~Cookie() {
+		if (cookie != nullptr) {
+			magic_close(cookie);
+		}
+	}
+};
+
+MagicDetector& MagicDetector::instance() {
+	static MagicDetector detector;
+	return detector;
+}
+
+MagicDetector::MagicDetector() {
+	// Load the cookie of the current thread now, to report a broken magic database as soon as possible
+	thread_cookie();
+}
+
+MagicDetector::Cookie& MagicDetector::thread_cookie() {
+	// The detector is process-wide, so a single cookie per thread is enough
+	thread_local Cookie cookie;
+
+	if (cookie.cookie == nullptr) {
+		load_cookie(cookie);
+	}
+
+	return cookie;
+}
+
+void MagicDetector::load_cookie(Cookie& cookie) {
+	const auto start = std::chrono::steady_clock::now();
+
+	magic_t magic_cookie = magic_open(magic_flags);
+
+	if (magic_cookie == nullptr) {
+		throw ReadMetadataError("Unable to initialize the magic library");
+	}
+
+	// The default database, found the way libmagic usually does
+	if (magic_load(magic_cookie, nullptr) != 0) {
+		const std::string error = magic_error(magic_cookie) != nullptr ? magic_error(magic_cookie) : "unknown error";
+		magic_close(magic_cookie);
+		throw ReadMetadataError(("Cannot load magic database: " + error).c_str());
+	}
+
+	cookie.cookie = magic_cookie;
+
+	++cookie_count_;
+	cookie_load_time_ += static_cast<std::uint64_t>(elapsed_since(start).count());
+}
+
+std::string MagicDetector::mime_type(const char* filename) {
+	magic_t magic_cookie = thread_cookie().cookie;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	const char* mime_type = magic_file(magic_cookie, filename);
+	if (mime_type == nullptr) {
+		const char* error = magic_error(magic_cookie);
+		throw ReadMetadataError((std::string("Cannot detect the type of the resource: ")
+		                        + (error != nullptr ? error : filename)).c_str());
+	}
+
+	std::string result = mime_type;
+
+	++detection_count_;
+	detection_time_ += static_cast<std::uint64_t>(elapsed_since(start).count());
+
+	return result;
+}
+
+MagicDetector::Stats MagicDetector::stats() const {
+	return {
+		cookie_count_.load(),
+		std::chrono::nanoseconds(cookie_load_time_.load()),
+		detection_count_.load(),
+		std::chrono::nanoseconds(detection_time_.load()),
+	};
+}
+
+}} // namespace reven::metadata
@@ -0,0 +1,40 @@
+#pragma once
+
+// USDT probes of the `rvnmetadata` provider, for perf and bpftrace, compiled in with -DENABLE_USDT_PROBES=ON:
+//  * detect__start(path), detect__done(path, format, sniffed_bytes)
+//  * open__start(path, format, write), open__done(path, format, write): opening with the library of the format
+//  * close(path, format): the library of the format is about to be closed
+//  * read__start(path, format), read__done(path, format, read_bytes)
+//  * write__start(path, format), write__done(path, format)
+//  * error(path, message): an exception escapes a read or a write, including the ones of the callbacks
+// `format` is "sqlite", "binary" or "json" and `write` is 1 when opening for writing.
+// `sniffed_bytes` is the number of bytes read to identify the format, not counting the reads of libmagic when they
+// are not enough. `read_bytes` is the number of bytes the metadata were read from:
+//  * binary: the size of the header decoded, which has already been read while identifying the format
+//  * json: the bytes read from the file after the sniffed ones, until the end of the metadata, plus its last bytes
+//  * sqlite: the page size times the number of pages read from the file
+//  * 0 when the library of the format read them, which doesn't report it
+// e.g. bpftrace -e 'usdt:./librvnmetadata-file.so:rvnmetadata:read__done { @[str(arg1)] = hist(arg2); }'
+// When the option is off, the probes compile to nothing and their arguments are not evaluated.
+
+#if RVNMETADATA_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define RVNMETADATA_PROBE(name, ...) STAP_PROBEV(rvnmetadata, name, __VA_ARGS__)
+
+#else
+
+namespace reven {
+namespace metadata {
+namespace probes {
+
+// Never defined: only used in unevaluated operands, so the arguments of the disabled probes count as used
+template <typename... Args>
+int unused(const Args&...);
+
+}}} // namespace reven::metadata::probes
+
+#define RVNMETADATA_PROBE(name, ...) static_cast<void>(sizeof(::reven::metadata::probes::unused(__VA_ARGS__)))
+
+#endif
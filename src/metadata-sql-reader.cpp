@@ -0,0 +1,206 @@
+#include "metadata-sql-reader.h"
+
+#include <cstdio>
+#include <limits>
+
+#include <sys/stat.h>
+
+#include <sqlite3.h>
+
+namespace reven {
+namespace metadata {
+namespace sqlreader {
+
+namespace {
+
+// Version of the metadata table supported here, the others are left to the rvnsqlite reader
+constexpr sqlite3_int64 metadata_version = 1;
+
+constexpr char metadata_query[] =
+	"SELECT metadata_version, type, format_version, tool_name, tool_version, tool_info, generation_date "
+	"FROM _metadata";
+
+constexpr char type_query[] = "SELECT metadata_version, type FROM _metadata";
+
+///
+/// Build the URI opening `filename` as an immutable database, which disables the locks and the journal
+///
+std::string immutable_uri(const char* filename) {
+	std::string uri = "file:";
+	for (const char* c = filename; *c != '\0'; ++c) {
+		// Only the characters with a meaning in a URI need to be escaped
+		if (*c == '%' || *c == '?' || *c == '#') {
+			char escaped[4];
+			std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(*c));
+			uri += escaped;
+		} else {
+			uri += *c;
+		}
+	}
+	return uri + "?mode=ro&immutable=1";
+}
+
+bool file_exists(const std::string& filename) {
+	struct stat file_stat;
+	return ::stat(filename.c_str(), &file_stat) == 0;
+}
+
+///
+/// Names of the files next to a database that hold the changes not written to it yet
+///
+struct JournalNames {
+	explicit JournalNames(const std::string& filename) : journal(filename + "-journal"), wal(filename + "-wal") {}
+
+	bool exist() const {
+		return file_exists(journal) || file_exists(wal);
+	}
+
+	std::string journal;
+	std::string wal;
+};
+
+///
+/// Identity and last modification of a file, to detect that it was replaced or written to
+///
+struct FileState {
+	dev_t device;
+	ino_t inode;
+	off_t size;
+	struct timespec mtime;
+
+	bool operator==(const FileState& state) const {
+		return device == state.device && inode == state.inode && size == state.size &&
+		       mtime.tv_sec == state.mtime.tv_sec && mtime.tv_nsec == state.mtime.tv_nsec;
+	}
+};
+
+bool stat_file(const std::string& filename, FileState& state) {
+	struct stat file_stat;
+	if (::stat(filename.c_str(), &file_stat) != 0) {
+		return false;
+	}
+
+	state = FileState{file_stat.st_dev, file_stat.st_ino, file_stat.st_size, file_stat.st_mtim};
+	return true;
+}
+
+class Database {
+public:
+	explicit Database(const std::string& uri) {
+		if (sqlite3_open_v2(uri.c_str(), &db_, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI | SQLITE_OPEN_NOMUTEX,
+		                    nullptr) != SQLITE_OK) {
+			sqlite3_close(db_);
+			db_ = nullptr;
+		}
+	}
+
+	~Database() {
+		sqlite3_finalize(stmt_);
+		sqlite3_close(db_);
+	}
+
+	Database(const Database&) = delete;
+	Database& operator=(const Database&) = delete;
+
+	// Prepare the statement and step to its first row
+	bool query(const char* sql) {
+		return db_ != nullptr && sqlite3_prepare_v2(db_, sql, -1, &stmt_, nullptr) == SQLITE_OK &&
+		       sqlite3_step(stmt_) == SQLITE_ROW;
+	}
+
+	bool is_last_row() {
+		return sqlite3_step(stmt_) == SQLITE_DONE;
+	}
+
+	// Number of bytes read from the file so far, from the pages that missed the page cache
+	std::size_t bytes_read() {
+		int pages_read = 0;
+		int highwater = 0;
+		sqlite3_stmt* page_size_stmt = nullptr;
+		std::size_t bytes = 0;
+		if (sqlite3_db_status(db_, SQLITE_DBSTATUS_CACHE_MISS, &pages_read, &highwater, 0) == SQLITE_OK &&
+		    sqlite3_prepare_v2(db_, "PRAGMA page_size", -1, &page_size_stmt, nullptr) == SQLITE_OK &&
+		    sqlite3_step(page_size_stmt) == SQLITE_ROW) {
+			bytes = static_cast<std::size_t>(pages_read) *
+			        static_cast<std::size_t>(sqlite3_column_int64(page_size_stmt, 0));
+		}
+		sqlite3_finalize(page_size_stmt);
+		return bytes;
+	}
+
+	bool column(int index, sqlite3_int64& value) {
+		if (sqlite3_column_type(stmt_, index) != SQLITE_INTEGER) {
+			return false;
+		}
+		value = sqlite3_column_int64(stmt_, index);
+		return true;
+	}
+
+	bool column(int index, std::string& value) {
+		if (sqlite3_column_type(stmt_, index) != SQLITE_TEXT) {
+			return false;
+		}
+		const auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, index));
+		value.assign(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt_, index)));
+		return true;
+	}
+
+private:
+	sqlite3* db_ = nullptr;
+	sqlite3_stmt* stmt_ = nullptr;
+};
+
+} // anonymous namespace
+
+bool read(const char* filename, MetadataFields fields, SqlMetadata& md) {
+	// An immutable database ignores the locks, the journal and the WAL, which may hold changes that are not in the
+	// file yet. A writer may also start after the journal is checked: the file is checked again after the read.
+	const std::string name = filename;
+	const JournalNames journal_names(name);
+	FileState state_before;
+	if (journal_names.exist() || !stat_file(name, state_before)) {
+		return false;
+	}
+
+	const bool type_only = (fields & ~MetadataFields::Type) == MetadataFields::None;
+
+	Database db(immutable_uri(filename));
+	if (!db.query(type_only ? type_query : metadata_query)) {
+		return false;
+	}
+
+	sqlite3_int64 version;
+	sqlite3_int64 type;
+	sqlite3_int64 generation_date = 0;
+	if (!db.column(0, version) || version != metadata_version ||
+	    !db.column(1, type) || type < 0 || type > std::numeric_limits<std::uint32_t>::max()) {
+		return false;
+	}
+	if (!type_only &&
+	    (!db.column(2, md.format_version) || !db.column(3, md.tool_name) ||
+	     !db.column(4, md.tool_version) || !db.column(5, md.tool_info) ||
+	     !db.column(6, generation_date) || generation_date < 0)) {
+		return false;
+	}
+
+	// A single row is expected, otherwise which one is used is up to the rvnsqlite reader
+	if (!db.is_last_row()) {
+		return false;
+	}
+
+	// A write overlapping the read changes the modification time of the file, and unless the journal is disabled, it
+	// leaves a journal or a WAL while it is not committed. Only a write committed within the same modification time,
+	// on a file system with a coarse one, can go unnoticed.
+	FileState state_after;
+	if (journal_names.exist() || !stat_file(name, state_after) || !(state_after == state_before)) {
+		return false;
+	}
+
+	md.type = static_cast<std::uint32_t>(type);
+	md.generation_date = static_cast<std::uint64_t>(generation_date);
+	md.fields = type_only ? MetadataFields::Type : MetadataFields::All;
+	md.bytes_read = db.bytes_read();
+	return true;
+}
+
+}}} // namespace reven::metadata::sqlreader
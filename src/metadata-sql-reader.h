@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "metadata-view.h"
+
+namespace reven {
+namespace metadata {
+namespace sqlreader {
+
+///
+/// Metadata read from a sqlite resource, owning its strings
+///
+struct SqlMetadata {
+	std::uint32_t type = 0;
+	std::string format_version;
+	std::string tool_name;
+	std::string tool_version;
+	std::string tool_info;
+	std::uint64_t generation_date = 0;
+	/// The fields that have been read
+	MetadataFields fields = MetadataFields::All;
+	/// The number of bytes read from the file: the page size times the number of pages read
+	std::size_t bytes_read = 0;
+
+	///
+	/// \brief view get a view over these metadata, which must outlive it
+	MetadataView view() const {
+		return MetadataView(type, format_version, tool_name, tool_version, tool_info, generation_date)
+			.restrict_fields(fields);
+	}
+};
+
+///
+/// \brief read Read the metadata of a sqlite resource through an immutable, read-only connection
+/// The database is opened without locking nor journal handling, and the metadata table is read with a single
+/// statement. Resources with a journal or a WAL file next to them, before or after the read, are not read that way,
+/// as their content could differ from the one of the database file alone. Neither are the resources whose file was
+/// replaced or modified during the read: a write that started after the journal was checked is detected this way,
+/// except on file systems whose modification times are too coarse to tell the write from the read.
+/// \param filename The sqlite resource
+/// \param fields The fields that are needed: only the type is selected if it is the only one
+/// \param md Set to the metadata on success
+/// \return false if the metadata can't be read that way, e.g. the database can't be opened, has a journal, doesn't
+///   have the current metadata table or its content is unexpected. The rvnsqlite reader must then be used to get its
+///   result or error.
+bool read(const char* filename, MetadataFields fields, SqlMetadata& md);
+
+}}} // namespace reven::metadata::sqlreader
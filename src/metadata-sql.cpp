@@ -17,15 +17,18 @@ public:
 };
 } // anonymous namespace
 
-Metadata from_raw_metadata(const reven::sqlite::Metadata& md) {
-	return Metadata(
-		static_cast<ResourceType>(md.type()),
-		Version::from_string(md.format_version()),
-		md.tool_name(), Version::from_string(md.tool_version()), md.tool_info(),
-		std::chrono::system_clock::time_point{std::chrono::seconds(md.generation_date())}
+MetadataView view_raw_metadata(const reven::sqlite::Metadata& md) {
+	return MetadataView(
+		md.type(), md.format_version(),
+		md.tool_name(), md.tool_version(), md.tool_info(),
+		md.generation_date()
 	);
 }
 
+Metadata from_raw_metadata(const reven::sqlite::Metadata& md) {
+	return view_raw_metadata(md).to_metadata();
+}
+
 reven::sqlite::Metadata to_sqlite_raw_metadata(const Metadata& md) {
 	if (not md.custom_metadata().empty()) {
 		throw WriteMetadataError("SQLITE resource does not support custom metadata.");
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "metadata-stats.h"
+
+namespace reven {
+namespace metadata {
+namespace stats {
+
+// Whether the stages are recorded, checked before reading the clock
+extern std::atomic<bool> enabled_flag;
+
+inline bool enabled() {
+	return enabled_flag.load(std::memory_order_relaxed);
+}
+
+///
+/// \brief record Add a call of `duration` to the stats of `stage`
+void record(Stage stage, std::chrono::nanoseconds duration);
+
+///
+/// \brief record_fallback Count a read that couldn't use the fast path of its format
+void record_fallback();
+
+///
+/// Record the time spent in a stage until its destruction, including when an exception is thrown
+/// Does nothing if the stats are disabled at its construction.
+///
+class StageTimer {
+public:
+	explicit StageTimer(Stage stage)
+		: stage_(stage)
+		, running_(enabled())
+	{
+		if (running_) {
+			start_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	~StageTimer() {
+		if (running_) {
+			record(stage_, std::chrono::steady_clock::now() - start_);
+		}
+	}
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	Stage stage_;
+	bool running_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+///
+/// \brief timed Call `fn` while recording its time in `stage`, returning what it returns
+template <typename Fn>
+auto timed(Stage stage, Fn&& fn) -> decltype(fn()) {
+	StageTimer timer(stage);
+	return fn();
+}
+
+}}} // namespace reven::metadata::stats
@@ -0,0 +1,234 @@
+#include "metadata-stats.h"
+#include "metadata-stats-recorder.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace reven {
+namespace metadata {
+
+namespace stats {
+
+std::atomic<bool> enabled_flag{false};
+
+} // namespace stats
+
+namespace {
+
+constexpr const char* stage_names[stage_count] = {
+	"detect", "open", "read_raw", "convert", "validate", "write",
+};
+
+///
+/// Counters of a stage, on their own cache line so the stages recorded by different threads don't contend
+///
+struct alignas(64) StageCounters {
+	std::atomic<std::uint64_t> count;
+	std::atomic<std::uint64_t> total_time;
+	std::array<std::atomic<std::uint64_t>, StageStats::bucket_count> buckets;
+};
+
+// Zero-initialized, as they have a static storage duration
+std::array<StageCounters, stage_count> stage_counters;
+std::atomic<std::uint64_t> fallback_count;
+
+std::size_t bucket_index(std::chrono::nanoseconds duration) {
+	std::size_t bucket = 0;
+	while (bucket + 1 < StageStats::bucket_count && duration >= StageStats::bucket_bound(bucket)) {
+		++bucket;
+	}
+	return bucket;
+}
+
+// Upper bound of the bucket holding the call at `ratio` of the calls ordered by duration
+std::chrono::nanoseconds percentile_bound(const StageStats& stage, double ratio) {
+	const auto rank = static_cast<std::uint64_t>(ratio * static_cast<double>(stage.count));
+
+	std::uint64_t calls = 0;
+	for (std::size_t bucket = 0; bucket < StageStats::bucket_count; ++bucket) {
+		calls += stage.buckets[bucket];
+		if (calls > rank) {
+			return StageStats::bucket_bound(bucket);
+		}
+	}
+	return StageStats::bucket_bound(StageStats::bucket_count - 1);
+}
+
+// Throw if `format` can't be passed to write_stats
+void check_stats_format(std::experimental::string_view format) {
+	if (format != "text" && format != "prometheus") {
+		throw MetadataError(("Unknown stats format \"" + format.to_string()
+		                     + "\", choose \"text\" or \"prometheus\"").c_str());
+	}
+}
+
+std::string bound_to_string(std::chrono::nanoseconds bound) {
+	if (bound == std::chrono::nanoseconds::max()) {
+		return "inf";
+	}
+	return "< " + std::to_string(bound.count() / 1000);
+}
+
+double to_seconds(std::chrono::nanoseconds duration) {
+	return std::chrono::duration<double>(duration).count();
+}
+
+} // anonymous namespace
+
+constexpr std::size_t StageStats::bucket_count;
+
+std::chrono::nanoseconds StageStats::bucket_bound(std::size_t bucket) {
+	if (bucket + 1 >= bucket_count) {
+		return std::chrono::nanoseconds::max();
+	}
+	return std::chrono::nanoseconds(std::chrono::microseconds(1)) * (std::int64_t(1) << (2 * bucket));
+}
+
+std::experimental::string_view to_string(Stage stage) {
+	return stage_names[static_cast<std::size_t>(stage)];
+}
+
+namespace stats {
+
+void record(Stage stage, std::chrono::nanoseconds duration) {
+	auto& counters = stage_counters[static_cast<std::size_t>(stage)];
+
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.total_time.fetch_add(static_cast<std::uint64_t>(duration.count()), std::memory_order_relaxed);
+	counters.buckets[bucket_index(duration)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void record_fallback() {
+	if (enabled()) {
+		fallback_count.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+} // namespace stats
+
+void enable_metadata_stats() {
+	stats::enabled_flag = true;
+}
+
+void disable_metadata_stats() {
+	stats::enabled_flag = false;
+}
+
+bool metadata_stats_enabled() {
+	return stats::enabled();
+}
+
+MetadataStats metadata_stats() {
+	MetadataStats result;
+
+	for (std::size_t stage = 0; stage < stage_count; ++stage) {
+		const auto& counters = stage_counters[stage];
+		auto& stage_stats = result.stages[stage];
+
+		stage_stats.count = counters.count.load(std::memory_order_relaxed);
+		stage_stats.total_time = std::chrono::nanoseconds(counters.total_time.load(std::memory_order_relaxed));
+		for (std::size_t bucket = 0; bucket < StageStats::bucket_count; ++bucket) {
+			stage_stats.buckets[bucket] = counters.buckets[bucket].load(std::memory_order_relaxed);
+		}
+	}
+	result.fallbacks = fallback_count.load(std::memory_order_relaxed);
+
+	return result;
+}
+
+void reset_metadata_stats() {
+	for (auto& counters : stage_counters) {
+		counters.count = 0;
+		counters.total_time = 0;
+		for (auto& bucket : counters.buckets) {
+			bucket = 0;
+		}
+	}
+	fallback_count = 0;
+}
+
+void write_stats_text(std::ostream& out, const MetadataStats& stats) {
+	std::ostringstream table;
+	table << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "count"
+	      << std::setw(14) << "total (ms)" << std::setw(12) << "mean (us)" << std::setw(12) << "p50 (us)"
+	      << std::setw(12) << "p99 (us)" << "\n";
+
+	for (std::size_t stage = 0; stage < stage_count; ++stage) {
+		const auto& stage_stats = stats.stages[stage];
+		const double total_us = static_cast<double>(stage_stats.total_time.count()) / 1000.;
+
+		table << std::left << std::setw(10) << stage_names[stage] << std::right << std::setw(10) << stage_stats.count
+		      << std::fixed << std::setprecision(3) << std::setw(14) << total_us / 1000.
+		      << std::setprecision(1) << std::setw(12)
+		      << (stage_stats.count == 0 ? 0. : total_us / static_cast<double>(stage_stats.count));
+		if (stage_stats.count == 0) {
+			table << std::setw(12) << "-" << std::setw(12) << "-" << "\n";
+		} else {
+			table << std::setw(12) << bound_to_string(percentile_bound(stage_stats, 0.5))
+			      << std::setw(12) << bound_to_string(percentile_bound(stage_stats, 0.99)) << "\n";
+		}
+	}
+	table << "read fallbacks: " << stats.fallbacks << "\n";
+
+	out << table.str();
+}
+
+void write_stats_prometheus(std::ostream& out, const MetadataStats& stats) {
+	std::ostringstream metrics;
+	metrics << std::setprecision(9);
+
+	metrics << "# HELP rvnmetadata_stage_duration_seconds Time spent in each stage of reading and writing metadata.\n"
+	        << "# TYPE rvnmetadata_stage_duration_seconds histogram\n";
+	for (std::size_t stage = 0; stage < stage_count; ++stage) {
+		const auto& stage_stats = stats.stages[stage];
+		const std::string labels = std::string("stage=\"") + stage_names[stage] + "\"";
+
+		// The buckets are cumulative, and the count is taken from them so they are consistent in any snapshot
+		std::uint64_t cumulative_count = 0;
+		for (std::size_t bucket = 0; bucket < StageStats::bucket_count; ++bucket) {
+			cumulative_count += stage_stats.buckets[bucket];
+
+			metrics << "rvnmetadata_stage_duration_seconds_bucket{" << labels << ",le=\"";
+			if (bucket + 1 < StageStats::bucket_count) {
+				metrics << to_seconds(StageStats::bucket_bound(bucket));
+			} else {
+				metrics << "+Inf";
+			}
+			metrics << "\"} " << cumulative_count << "\n";
+		}
+		metrics << "rvnmetadata_stage_duration_seconds_sum{" << labels << "} " << to_seconds(stage_stats.total_time)
+		        << "\n"
+		        << "rvnmetadata_stage_duration_seconds_count{" << labels << "} " << cumulative_count << "\n";
+	}
+
+	metrics << "# HELP rvnmetadata_read_fallbacks_total Reads that fell back to the library of the resource format.\n"
+	        << "# TYPE rvnmetadata_read_fallbacks_total counter\n"
+	        << "rvnmetadata_read_fallbacks_total " << stats.fallbacks << "\n";
+
+	out << metrics.str();
+}
+
+void write_stats(std::ostream& out, const MetadataStats& stats, std::experimental::string_view format) {
+	check_stats_format(format);
+
+	if (format == "prometheus") {
+		write_stats_prometheus(out, stats);
+	} else {
+		write_stats_text(out, stats);
+	}
+}
+
+StatsReport::StatsReport(std::ostream& out, std::experimental::string_view format)
+	: out_(out)
+	, format_(format == "prometheus" ? "prometheus" : "text")
+{
+	check_stats_format(format);
+	enable_metadata_stats();
+}
+
+StatsReport::~StatsReport() {
+	disable_metadata_stats();
+	write_stats(out_, metadata_stats(), format_);
+}
+
+}} // namespace reven::metadata
@@ -0,0 +1,168 @@
+#include "metadata-validate.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RVN_METADATA_X86 1
+#include <immintrin.h>
+#endif
+
+namespace reven {
+namespace metadata {
+namespace validate {
+
+constexpr std::size_t ScanResult::npos;
+
+namespace {
+
+bool is_printable(char c) {
+	return c >= 0x20 && c <= 0x7e;
+}
+
+#if RVN_METADATA_X86
+
+// Offset of the lowest bit set
+unsigned lowest_bit(std::uint32_t mask) {
+	return static_cast<unsigned>(__builtin_ctz(mask));
+}
+
+// Update `result` with the masks of a chunk starting at `offset`, return true if the scan is over
+bool scan_masks(std::uint32_t unprintable_mask, std::uint32_t dot_mask, std::size_t offset, ScanResult& result) {
+	if (unprintable_mask != 0) {
+		const auto position = lowest_bit(unprintable_mask);
+		result.first_unprintable = offset + position;
+
+		// Only the dots before the unprintable character count
+		dot_mask &= (std::uint32_t(1) << position) - 1;
+	}
+
+	if (dot_mask != 0 && result.first_dot == ScanResult::npos) {
+		result.first_dot = offset + lowest_bit(dot_mask);
+	}
+
+	return unprintable_mask != 0;
+}
+
+// Scan the bytes after `offset` that don't fill a whole vector
+ScanResult scan_tail(const char* data, std::size_t size, std::size_t offset, ScanResult result) {
+	for (std::size_t i = offset; i < size; ++i) {
+		if (not is_printable(data[i])) {
+			result.first_unprintable = i;
+			return result;
+		}
+		if (data[i] == '.' && result.first_dot == ScanResult::npos) {
+			result.first_dot = i;
+		}
+	}
+	return result;
+}
+
+// SSE2 is the baseline on x86_64, not on i386 where it is selected at runtime like AVX2
+__attribute__((target("sse2")))
+ScanResult scan_sse2_impl(const char* data, std::size_t size) {
+	ScanResult result{ScanResult::npos, ScanResult::npos};
+
+	// Signed comparisons: the bytes >= 0x80 are negative, so not greater than 0x1f
+	const __m128i lower = _mm_set1_epi8(0x1f);
+	const __m128i upper = _mm_set1_epi8(0x7f);
+	const __m128i dot = _mm_set1_epi8('.');
+
+	std::size_t offset = 0;
+	for (; offset + 16 <= size; offset += 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, lower), _mm_cmplt_epi8(chunk, upper));
+
+		const auto unprintable_mask = static_cast<std::uint32_t>(~_mm_movemask_epi8(printable)) & 0xffff;
+		const auto dot_mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, dot)));
+
+		if (scan_masks(unprintable_mask, dot_mask, offset, result)) {
+			return result;
+		}
+	}
+
+	return scan_tail(data, size, offset, result);
+}
+
+__attribute__((target("avx2")))
+ScanResult scan_avx2_impl(const char* data, std::size_t size) {
+	ScanResult result{ScanResult::npos, ScanResult::npos};
+
+	const __m256i lower = _mm256_set1_epi8(0x1f);
+	const __m256i upper = _mm256_set1_epi8(0x7f);
+	const __m256i dot = _mm256_set1_epi8('.');
+
+	std::size_t offset = 0;
+	for (; offset + 32 <= size; offset += 32) {
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+		const __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, lower), _mm256_cmpgt_epi8(upper, chunk));
+
+		const auto unprintable_mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(printable));
+		const auto dot_mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, dot)));
+
+		if (scan_masks(unprintable_mask, dot_mask, offset, result)) {
+			return result;
+		}
+	}
+
+	return scan_tail(data, size, offset, result);
+}
+
+#endif
+
+ScanFunction best_scan_function() {
+	if (auto avx2 = scan_avx2()) {
+		return avx2;
+	}
+	if (auto sse2 = scan_sse2()) {
+		return sse2;
+	}
+	return scan_scalar;
+}
+
+} // anonymous namespace
+
+ScanResult scan_scalar(const char* data, std::size_t size) {
+	ScanResult result{ScanResult::npos, ScanResult::npos};
+
+	for (std::size_t i = 0; i < size; ++i) {
+		if (not is_printable(data[i])) {
+			result.first_unprintable = i;
+			break;
+		}
+		if (data[i] == '.' && result.first_dot == ScanResult::npos) {
+			result.first_dot = i;
+		}
+	}
+
+	return result;
+}
+
+ScanFunction scan_sse2() {
+#if RVN_METADATA_X86
+	if (__builtin_cpu_supports("sse2")) {
+		return scan_sse2_impl;
+	}
+#endif
+	return nullptr;
+}
+
+ScanFunction scan_avx2() {
+#if RVN_METADATA_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return scan_avx2_impl;
+	}
+#endif
+	return nullptr;
+}
+
+ScanResult scan(const char* data, std::size_t size) {
+	static const ScanFunction scan_function = best_scan_function();
+
+	// Vectors don't pay off on the usual short keys
+	if (size < 16) {
+		return scan_scalar(data, size);
+	}
+	return scan_function(data, size);
+}
+
+}}} // namespace reven::metadata::validate
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace reven {
+namespace metadata {
+
+class CustomMetadata;
+
+namespace validate {
+
+///
+/// Result of the scan of a custom metadata key or value
+///
+struct ScanResult {
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	/// Offset of the first character that isn't printable ASCII (0x20-0x7e), npos if there is none
+	std::size_t first_unprintable;
+	/// Offset of the first '.' before the first unprintable character, npos if there is none
+	std::size_t first_dot;
+};
+
+using ScanFunction = ScanResult (*)(const char* data, std::size_t size);
+
+///
+/// \brief scan Look for unprintable characters and dots in a single pass
+/// Uses the widest vector instructions supported by the CPU, detected once.
+ScanResult scan(const char* data, std::size_t size);
+
+/// Implementations used by `scan`, exposed for the tests. Null if not available on this CPU.
+ScanResult scan_scalar(const char* data, std::size_t size);
+ScanFunction scan_sse2();
+ScanFunction scan_avx2();
+
+///
+/// \brief check_custom_metadata Check that a custom metadata key and value are printable and the key has no '.'
+/// \throws MetadataError describing the first invalid character
+void check_custom_metadata(const std::string& key, const std::string& value);
+
+///
+/// \brief check_custom_metadata Check every entry of the custom metadata
+/// \throws MetadataError describing the first invalid character
+void check_custom_metadata(const CustomMetadata& custom_metadata);
+
+}}} // namespace reven::metadata::validate
@@ -0,0 +1,53 @@
+#include "metadata-view.h"
+#include "metadata-validate.h"
+
+namespace reven {
+namespace metadata {
+
+ResourceType MetadataView::type() const {
+	check_fields(MetadataFields::Type);
+	if (type_ < static_cast<std::uint32_t>(ResourceType::_MinValue) ||
+	    type_ > static_cast<std::uint32_t>(ResourceType::_MaxValue)) {
+		throw UnknownMetadataTypeError("Unknown resource type");
+	}
+	return static_cast<ResourceType>(type_);
+}
+
+const Version& MetadataView::format_version() const {
+	check_fields(MetadataFields::FormatVersion);
+	if (!format_version_) {
+		format_version_ = Version::from_string(format_version_str_);
+	}
+	return *format_version_;
+}
+
+const Version& MetadataView::tool_version() const {
+	check_fields(MetadataFields::ToolVersion);
+	if (!tool_version_) {
+		tool_version_ = Version::from_string(tool_version_str_);
+	}
+	return *tool_version_;
+}
+
+CustomMetadata MetadataView::custom_metadata() const {
+	check_fields(MetadataFields::Custom);
+	if (custom_metadata_ == nullptr) {
+		return {};
+	}
+
+	auto custom_metadata = copy_custom_metadata_(custom_metadata_);
+	validate::check_custom_metadata(custom_metadata);
+	return custom_metadata;
+}
+
+Metadata MetadataView::to_metadata() const {
+	check_fields(MetadataFields::All);
+	return Metadata(
+		type(), format_version(),
+		tool_name_.to_string(), tool_version(), tool_info_.to_string(),
+		custom_metadata_ == nullptr ? CustomMetadata{} : copy_custom_metadata_(custom_metadata_),
+		generation_date()
+	);
+}
+
+}} // namespace reven::metadata
@@ -0,0 +1,52 @@
+#pragma once
+
+// Replaces the global allocation functions to count the allocations.
+// Must be included by a single translation unit of the executable.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<std::size_t> global_allocation_count{0};
+
+} // anonymous namespace
+
+void* operator new(std::size_t size) {
+	global_allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+//! Count the allocations made since its construction
+struct allocation_counter {
+	std::size_t start = global_allocation_count.load();
+
+	std::size_t count() const {
+		return global_allocation_count.load() - start;
+	}
+};
@@ -0,0 +1,30 @@
+# Scan a directory holding a valid resource, broken resources and a file that isn't a resource with metadata_reader:
+# only the file that isn't a resource may be skipped silently.
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}/sub")
+file(COPY "${TEST_DATA}/binary/good.bin" "${TEST_DATA}/foo.png" DESTINATION "${WORK_DIR}")
+file(COPY "${TEST_DATA}/binary/wrong_type.bin" "${TEST_DATA}/sqlite/without_metadata.sqlite"
+     DESTINATION "${WORK_DIR}/sub")
+
+execute_process(
+  COMMAND "${METADATA_READER}" "${WORK_DIR}" --type
+  RESULT_VARIABLE result
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE error
+)
+
+if(result EQUAL 0)
+  message(FATAL_ERROR "metadata_reader succeeded with broken resources:\n${output}${error}")
+endif()
+if(NOT output MATCHES "good.bin")
+  message(FATAL_ERROR "The valid resource is missing from the output:\n${output}")
+endif()
+foreach(broken wrong_type.bin without_metadata.sqlite)
+  if(NOT error MATCHES "${broken}")
+    message(FATAL_ERROR "The error of ${broken} isn't reported:\n${error}")
+  endif()
+endforeach()
+if(error MATCHES "foo.png" OR output MATCHES "foo.png")
+  message(FATAL_ERROR "The file that isn't a resource isn't skipped:\n${output}${error}")
+endif()
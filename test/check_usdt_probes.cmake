@@ -0,0 +1,20 @@
+# List the notes of the file library built with ENABLE_USDT_PROBES=ON: each probe of src/metadata-probes.h must be
+# there, in the rvnmetadata provider, for perf and bpftrace to find it.
+
+execute_process(
+  COMMAND "${READELF}" --notes "${LIBRARY}"
+  RESULT_VARIABLE result
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE error
+)
+
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "readelf failed on ${LIBRARY}:\n${error}")
+endif()
+
+foreach(probe detect__start detect__done open__start open__done close read__start read__done write__start write__done
+              error)
+  if(NOT output MATCHES "Provider: rvnmetadata[\r\n]+ *Name: ${probe}[\r\n]")
+    message(FATAL_ERROR "The probe rvnmetadata:${probe} is missing from ${LIBRARY}:\n${output}")
+  endif()
+endforeach()
@@ -2,12 +2,29 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem.hpp>
 
+#include <fstream>
+#include <random>
+#include <thread>
+
 #include <rvnsqlite/resource_database.h>
 #include <rvnbinresource/metadata.h>
+#include <rvnbinresource/reader.h>
 #include <rvnjsonresource/metadata.h>
+#include <rvnjsonresource/reader.h>
 
+#include "allocation_counter.h"
 #include "test_helpers.h"
 
+#include <metadata-cache.h>
+#include <metadata-catalog.h>
+#include <metadata-magic.h>
+#include <metadata-stats.h>
+
+#include "metadata-bin-header.h"
+#include "metadata-json-stream.h"
+#include "metadata-sql-reader.h"
+#include "metadata-validate.h"
+
 BOOST_AUTO_TEST_CASE(sqlite_raw_metadata)
 {
 	Metadata md(
@@ -213,6 +230,352 @@ BOOST_AUTO_TEST_CASE(resource_json_good)
 	BOOST_CHECK(md.generation_date() == std::chrono::system_clock::time_point{std::chrono::seconds(42424242)});
 }
 
+BOOST_AUTO_TEST_CASE(magic_detector_multithread)
+{
+	auto& detector = reven::metadata::MagicDetector::instance();
+	BOOST_CHECK(&detector == &reven::metadata::MagicDetector::instance());
+
+	const std::vector<std::string> files {
+		TEST_DATA "/foo.png", TEST_DATA "/sqlite/good.sqlite", TEST_DATA "/binary/good.bin", TEST_DATA "/json/good.json",
+	};
+
+	std::vector<std::string> expected;
+	for (const auto& file : files) {
+		expected.push_back(detector.mime_type(file.c_str()));
+	}
+	BOOST_CHECK(expected[0] == "image/png");
+
+	const auto stats_before = detector.stats();
+
+	constexpr unsigned thread_count = 4;
+	constexpr unsigned iterations = 10;
+	std::vector<unsigned> mismatches(thread_count, 0);
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < thread_count; ++i) {
+		threads.emplace_back([&, i]() {
+			for (unsigned j = 0; j < iterations; ++j) {
+				for (std::size_t k = 0; k < files.size(); ++k) {
+					if (detector.mime_type(files[k].c_str()) != expected[k])
+						++mismatches[i];
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	for (auto mismatch : mismatches) {
+		BOOST_CHECK_EQUAL(mismatch, 0u);
+	}
+
+	const auto stats = detector.stats();
+	BOOST_CHECK_EQUAL(stats.detection_count - stats_before.detection_count, thread_count * iterations * files.size());
+	// One cookie per new thread
+	BOOST_CHECK_EQUAL(stats.cookie_count - stats_before.cookie_count, thread_count);
+}
+
+BOOST_AUTO_TEST_CASE(resource_format_without_libmagic)
+{
+	const auto& detector = reven::metadata::MagicDetector::instance();
+	const auto detection_count = detector.stats().detection_count;
+
+	BOOST_CHECK_NO_THROW(reven::metadata::from_resource(TEST_DATA "/sqlite/good.sqlite"));
+	BOOST_CHECK_NO_THROW(reven::metadata::from_resource(TEST_DATA "/binary/good.bin"));
+	BOOST_CHECK_NO_THROW(reven::metadata::from_resource(TEST_DATA "/binary/outdated.bin"));
+	BOOST_CHECK_NO_THROW(reven::metadata::from_resource(TEST_DATA "/json/good.json"));
+
+	BOOST_CHECK_EQUAL(detector.stats().detection_count, detection_count);
+
+	// Unknown headers still go through libmagic
+	BOOST_CHECK_THROW(reven::metadata::from_resource(TEST_DATA "/foo.png"), reven::metadata::UnknownResourceError);
+	BOOST_CHECK_EQUAL(detector.stats().detection_count, detection_count + 1);
+}
+
+BOOST_AUTO_TEST_CASE(resources_batch)
+{
+	const std::vector<std::string> files {
+		TEST_DATA "/sqlite/good.sqlite", TEST_DATA "/foo.png", TEST_DATA "/binary/good.bin",
+		TEST_DATA "/json/wrong_type.json", TEST_DATA "/json/good.json", TEST_DATA "/does_not_exist.bin",
+	};
+
+	for (unsigned thread_count : {0u, 1u, 4u, 64u}) {
+		const auto results = reven::metadata::from_resources(files, thread_count);
+
+		BOOST_REQUIRE_EQUAL(results.size(), files.size());
+
+		BOOST_REQUIRE(results[0].has_metadata());
+		BOOST_CHECK(results[0].metadata().type() == ResourceType::MemHist);
+		BOOST_CHECK(!results[0].error());
+
+		BOOST_CHECK(!results[1].has_metadata());
+		BOOST_CHECK_THROW(results[1].metadata(), reven::metadata::UnknownResourceError);
+
+		BOOST_REQUIRE(results[2].has_metadata());
+		BOOST_CHECK(results[2].metadata().type() == ResourceType::TraceBin);
+
+		BOOST_CHECK(!results[3].has_metadata());
+		BOOST_CHECK_THROW(std::rethrow_exception(results[3].error()), reven::metadata::UnknownMetadataTypeError);
+
+		BOOST_REQUIRE(results[4].has_metadata());
+		BOOST_CHECK(results[4].metadata().type() == ResourceType::KernelDescription);
+
+		BOOST_CHECK(!results[5].has_metadata());
+		BOOST_CHECK_THROW(results[5].metadata(), reven::metadata::MetadataError);
+	}
+
+	BOOST_CHECK(reven::metadata::from_resources({}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(metadata_cache_lru)
+{
+	transient_directory tmp_dir{};
+
+	std::vector<std::string> files;
+	for (unsigned i = 0; i < 40; ++i) {
+		const auto file = tmp_dir.path / ("good" + std::to_string(i) + ".json");
+		boost::filesystem::copy_file(TEST_DATA "/json/good.json", file);
+		files.push_back(file.string());
+	}
+
+	unsigned load_count = 0;
+	auto load = [&load_count](const char* filename) {
+		++load_count;
+		return reven::metadata::from_resource(filename);
+	};
+
+	// 16 shards of 1 entry
+	reven::metadata::MetadataCache cache(16);
+
+	cache.get(files[0].c_str(), load);
+	cache.get(files[0].c_str(), load);
+	BOOST_CHECK_EQUAL(load_count, 1u);
+	BOOST_CHECK_EQUAL(cache.stats().hits, 1u);
+	BOOST_CHECK_EQUAL(cache.stats().misses, 1u);
+
+	for (const auto& file : files) {
+		cache.get(file.c_str(), load);
+	}
+
+	const auto stats = cache.stats();
+	BOOST_CHECK(stats.size <= 16);
+	BOOST_CHECK_EQUAL(stats.evictions, files.size() - stats.size);
+
+	// An entry used since it was stored gets a second chance when its shard is full
+	reven::metadata::MetadataCache clock_cache(16);
+	clock_cache.set_capacity(32);
+	for (const auto& file : files) {
+		clock_cache.get(files[0].c_str(), load);
+		clock_cache.get(file.c_str(), load);
+	}
+	load_count = 0;
+	clock_cache.get(files[0].c_str(), load);
+	BOOST_CHECK_EQUAL(load_count, 0u);
+
+	// A file replaced while it is read isn't cached under the key of the file that was opened
+	const auto replaced = tmp_dir.path / "replaced.json";
+	boost::filesystem::copy_file(TEST_DATA "/json/good.json", replaced);
+	auto replace_and_load = [&](const char* filename) {
+		boost::filesystem::remove(replaced);
+		boost::filesystem::copy_file(TEST_DATA "/json/good.json", replaced);
+		return reven::metadata::from_resource(filename);
+	};
+	reven::metadata::MetadataCache replaced_cache(16);
+	replaced_cache.get(replaced.c_str(), replace_and_load);
+	BOOST_CHECK_EQUAL(replaced_cache.stats().size, 0u);
+	replaced_cache.get(replaced.c_str(), load);
+	BOOST_CHECK_EQUAL(replaced_cache.stats().size, 1u);
+
+	cache.set_capacity(0);
+	BOOST_CHECK_EQUAL(cache.stats().size, 0u);
+
+	load_count = 0;
+	cache.get(files[0].c_str(), load);
+	cache.get(files[0].c_str(), load);
+	BOOST_CHECK_EQUAL(load_count, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_cache_process)
+{
+	transient_directory tmp_dir{};
+
+	const auto tmp_file = tmp_dir.path / "good.json";
+	boost::filesystem::copy_file(TEST_DATA "/json/good.json", tmp_file);
+
+	reven::metadata::enable_metadata_cache(8);
+	auto cache = reven::metadata::process_metadata_cache();
+	BOOST_REQUIRE(cache != nullptr);
+
+	const auto hits = cache->stats().hits;
+	const auto misses = cache->stats().misses;
+
+	BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).type() == ResourceType::KernelDescription);
+	BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).type() == ResourceType::KernelDescription);
+	BOOST_CHECK_EQUAL(cache->stats().misses, misses + 1);
+	BOOST_CHECK_EQUAL(cache->stats().hits, hits + 1);
+
+	// The process sees its own writes
+	set_metadata(
+		tmp_file.c_str(),
+		Metadata(
+			ResourceType::Strings,
+			Version(42, 42, 42),
+			"metadata_setter", Version(42, 42, 42), "metadata_setter info",
+			std::chrono::system_clock::time_point{std::chrono::seconds(242424)}
+		)
+	);
+	BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).type() == ResourceType::Strings);
+
+	// Changes made by others are detected from the size and the modification time
+	boost::filesystem::remove(tmp_file);
+	boost::filesystem::copy_file(TEST_DATA "/json/good.json", tmp_file);
+	BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).type() == ResourceType::KernelDescription);
+
+	// Errors are not cached
+	BOOST_CHECK_THROW(reven::metadata::from_resource(TEST_DATA "/foo.png"), reven::metadata::UnknownResourceError);
+	BOOST_CHECK_THROW(reven::metadata::from_resource(TEST_DATA "/foo.png"), reven::metadata::UnknownResourceError);
+
+	reven::metadata::disable_metadata_cache();
+	BOOST_CHECK(reven::metadata::process_metadata_cache() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(catalog_update_and_query)
+{
+	using reven::metadata::Catalog;
+
+	transient_directory catalog_dir{};
+	transient_directory tmp_dir{};
+	const auto root = boost::filesystem::canonical(tmp_dir.path);
+	const auto catalog_file = catalog_dir.path / "catalog.sqlite";
+
+	boost::filesystem::create_directories(root / "sub");
+	boost::filesystem::copy_file(TEST_DATA "/sqlite/good.sqlite", root / "good.sqlite");
+	boost::filesystem::copy_file(TEST_DATA "/binary/good.bin", root / "sub" / "good.bin");
+	boost::filesystem::copy_file(TEST_DATA "/json/good.json", root / "sub" / "good.json");
+	boost::filesystem::copy_file(TEST_DATA "/foo.png", root / "foo.png");
+
+	{
+		auto catalog = Catalog::open(catalog_file.c_str());
+
+		auto stats = catalog.update({root.string()}, 2);
+		BOOST_CHECK_EQUAL(stats.scanned, 4);
+		BOOST_CHECK_EQUAL(stats.read, 4);
+		BOOST_CHECK_EQUAL(stats.not_resources, 1);
+		BOOST_CHECK_EQUAL(stats.removed, 0);
+
+		// Nothing changed: no file is read again
+		stats = catalog.update({root.string()}, 2);
+		BOOST_CHECK_EQUAL(stats.scanned, 4);
+		BOOST_CHECK_EQUAL(stats.read, 0);
+	}
+
+	auto catalog = Catalog::open(catalog_file.c_str());
+
+	auto entries = catalog.query({});
+	BOOST_REQUIRE_EQUAL(entries.size(), 3);
+	BOOST_CHECK_EQUAL(entries[0].path, (root / "good.sqlite").string());
+	BOOST_CHECK_EQUAL(entries[1].path, (root / "sub" / "good.bin").string());
+	BOOST_CHECK_EQUAL(entries[2].path, (root / "sub" / "good.json").string());
+	BOOST_CHECK(entries[0].metadata.type() == ResourceType::MemHist);
+	BOOST_CHECK(check_version_strict_equality(entries[0].metadata.tool_version(),
+	                                          Version(2, 42, 12, {{"test"}}, {{"dummy"}})));
+	BOOST_CHECK(entries[0].metadata.generation_date()
+	            == std::chrono::system_clock::time_point{std::chrono::seconds(42424242)});
+	BOOST_CHECK_EQUAL(reven::metadata::to_date_string(entries[0].metadata.generation_date()), "1971-05-07T00:30:42Z");
+
+	Catalog::Query query;
+	query.type = ResourceType::TraceBin;
+	entries = catalog.query(query);
+	BOOST_REQUIRE_EQUAL(entries.size(), 1);
+	BOOST_CHECK_EQUAL(entries[0].path, (root / "sub" / "good.bin").string());
+
+	query = {};
+	query.tool_version_max = Version(2, 42, 12);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 3); // 2.42.12-test < 2.42.12
+
+	query.tool_version_max = Version(2, 0, 0);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 2);
+
+	query = {};
+	query.tool_version_min = Version(2, 0, 0);
+	query.tool_name = std::string("TestMetaDataWriter");
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 1);
+
+	query = {};
+	query.path_prefix = (root / "sub").string();
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 2);
+
+	query = {};
+	query.custom.emplace_back("key", "value");
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 0);
+
+	// Removed and modified files
+	boost::filesystem::remove(root / "sub" / "good.bin");
+	reven::metadata::set_metadata((root / "sub" / "good.json").c_str(), Metadata(
+		ResourceType::Strings, Version(1, 0, 0), "catalog_test", Version(3, 0, 0), "", {{"key", "value"}}
+	));
+
+	const auto stats = catalog.update({root.string()}, 2);
+	BOOST_CHECK_EQUAL(stats.scanned, 3);
+	BOOST_CHECK_EQUAL(stats.read, 1);
+	BOOST_CHECK_EQUAL(stats.removed, 1);
+
+	entries = catalog.query(query);
+	BOOST_REQUIRE_EQUAL(entries.size(), 1);
+	BOOST_CHECK(entries[0].metadata.type() == ResourceType::Strings);
+	BOOST_CHECK(entries[0].metadata.tool_name() == "catalog_test");
+
+	// Version numbers that don't fit in a sqlite integer
+	const std::uint64_t huge = std::uint64_t(1) << 63;
+	reven::metadata::set_metadata((root / "sub" / "good.json").c_str(), Metadata(
+		ResourceType::Strings, Version(1, 0, 0), "catalog_test", Version(huge + 1, 5, 0), ""
+	));
+	catalog.update({root.string()}, 2);
+
+	for (const auto& bounds : std::vector<std::pair<Version, Version>>{
+		{Version(huge, 0, 0), Version(huge + 2, 0, 0)},
+		{Version(huge + 1, 0, 0), Version(huge + 1, 6, 0)},
+		{Version(huge + 1, 5, 0), Version(huge + 1, 5, 1)},
+	}) {
+		query = {};
+		query.tool_version_min = bounds.first;
+		query.tool_version_max = bounds.second;
+		entries = catalog.query(query);
+		BOOST_REQUIRE_EQUAL(entries.size(), 1);
+		BOOST_CHECK(entries[0].metadata.tool_version() == Version(huge + 1, 5, 0));
+	}
+
+	query = {};
+	query.tool_version_min = Version(huge + 1, 6, 0);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 0);
+	query.tool_version_min = Version(huge + 2, 0, 0);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 0);
+
+	query = {};
+	query.tool_version_max = Version(huge + 1, 5, 0);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 1); // Only good.sqlite
+
+	// The prerelease part of the bounds
+	query = {};
+	query.tool_version_min = Version(2, 42, 12, {{"test"}});
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 2);
+	query.tool_version_min = Version(2, 42, 12);
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 1);
+	query = {};
+	query.tool_version_max = Version(2, 42, 12, {{"test"}});
+	BOOST_CHECK_EQUAL(catalog.query(query).size(), 0);
+
+	// A resource that can't be read isn't recorded as a file that isn't a resource: the next update reads it again
+	boost::filesystem::copy_file(TEST_DATA "/sqlite/without_metadata.sqlite", root / "without_metadata.sqlite");
+	for (unsigned i = 0; i < 2; ++i) {
+		const auto broken_stats = catalog.update({root.string()}, 2);
+		BOOST_CHECK_EQUAL(broken_stats.read, 1);
+		BOOST_CHECK_EQUAL(broken_stats.errors, 1);
+		BOOST_CHECK_EQUAL(broken_stats.not_resources, 0);
+	}
+}
+
 constexpr const char* metadata_setter = "metadata_setter";
 constexpr const char* metadata_setter_info = "metadata_setter info";
 
@@ -555,6 +918,154 @@ BOOST_AUTO_TEST_CASE(set_metadata_resource_json_good)
 	BOOST_CHECK(md.generation_date() == std::chrono::system_clock::time_point{std::chrono::seconds(242424)});
 }
 
+BOOST_AUTO_TEST_CASE(update_metadata_resource)
+{
+	transient_directory tmp_dir{};
+
+	for (const char* filename : {"sqlite/good.sqlite", "binary/good.bin", "json/good.json"}) {
+		const auto source = boost::filesystem::path(TEST_DATA) / filename;
+		const auto tmp_file = tmp_dir.path / source.filename();
+		boost::filesystem::copy_file(source, tmp_file);
+
+		const auto old_md = reven::metadata::from_resource(tmp_file.c_str());
+
+		reven::metadata::update_metadata(tmp_file.c_str(), [&](Metadata md) {
+			BOOST_CHECK(md.type() == old_md.type());
+			BOOST_CHECK(md.tool_name() == old_md.tool_name());
+			return reven::metadata::MetadataBuilder(std::move(md)).tool_name(metadata_setter).build();
+		});
+
+		const auto md = reven::metadata::from_resource(tmp_file.c_str());
+		BOOST_CHECK(md.type() == old_md.type());
+		BOOST_CHECK(md.tool_name() == metadata_setter);
+		BOOST_CHECK(md.tool_info() == old_md.tool_info());
+
+		// The resource is left untouched if the callback throws
+		BOOST_CHECK_THROW(reven::metadata::update_metadata(tmp_file.c_str(), [](Metadata) -> Metadata {
+			throw std::runtime_error("Abort");
+		}), std::runtime_error);
+		BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).tool_name() == metadata_setter);
+	}
+
+	// A sqlite resource is read and written through a single connection
+	reven::metadata::reset_metadata_stats();
+	reven::metadata::enable_metadata_stats();
+	reven::metadata::update_metadata((tmp_dir.path / "good.sqlite").c_str(), [](Metadata md) { return md; });
+	reven::metadata::disable_metadata_stats();
+	BOOST_CHECK_EQUAL(reven::metadata::metadata_stats()[reven::metadata::Stage::Open].count, 1);
+	BOOST_CHECK_EQUAL(reven::metadata::metadata_stats()[reven::metadata::Stage::Write].count, 1);
+	reven::metadata::reset_metadata_stats();
+
+	const auto update = [&](const char* filename) {
+		const auto source = boost::filesystem::path(TEST_DATA) / filename;
+		const auto tmp_file = tmp_dir.path / ("error-" + source.filename().string());
+		boost::filesystem::copy_file(source, tmp_file);
+
+		reven::metadata::update_metadata(tmp_file.c_str(), [](Metadata md) { return md; });
+	};
+
+	// The same errors for every format: the ones of from_resource while reading, of set_metadata while writing
+	for (const char* filename : {"sqlite/without_metadata.sqlite", "binary/without_metadata.bin",
+	                             "json/without_metadata.json", "json/incompatible.json"}) {
+		BOOST_CHECK_THROW(update(filename), reven::metadata::ReadMetadataError);
+	}
+	for (const char* filename : {"sqlite/wrong_type.sqlite", "binary/wrong_type.bin", "json/wrong_type.json"}) {
+		BOOST_CHECK_THROW(update(filename), reven::metadata::UnknownMetadataTypeError);
+	}
+	for (const char* filename : {"sqlite/outdated.sqlite", "binary/outdated.bin"}) {
+		BOOST_CHECK_THROW(update(filename), reven::metadata::WriteMetadataError);
+	}
+	BOOST_CHECK_THROW(reven::metadata::update_metadata(TEST_DATA "/foo.png", [](Metadata md) { return md; }),
+	                  reven::metadata::UnknownResourceError);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_stats)
+{
+	using reven::metadata::Stage;
+
+	reven::metadata::reset_metadata_stats();
+	reven::metadata::from_resource(TEST_DATA "/binary/good.bin");
+	BOOST_CHECK_EQUAL(reven::metadata::metadata_stats()[Stage::Detect].count, 0);
+
+	reven::metadata::enable_metadata_stats();
+	BOOST_CHECK(reven::metadata::metadata_stats_enabled());
+
+	reven::metadata::from_resource(TEST_DATA "/binary/good.bin");
+	reven::metadata::from_resource(TEST_DATA "/sqlite/good.sqlite");
+	BOOST_CHECK_THROW(reven::metadata::from_resource(TEST_DATA "/json/without_metadata.json"),
+	                  reven::metadata::ReadMetadataError);
+
+	transient_directory tmp_dir{};
+	const auto tmp_file = tmp_dir.path / "good.json";
+	boost::filesystem::copy_file(boost::filesystem::path(TEST_DATA) / "json/good.json", tmp_file);
+	reven::metadata::set_metadata(tmp_file.c_str(), reven::metadata::from_resource(tmp_file.c_str()));
+
+	reven::metadata::disable_metadata_stats();
+	reven::metadata::from_resource(TEST_DATA "/binary/good.bin");
+
+	const auto stats = reven::metadata::metadata_stats();
+	BOOST_CHECK_EQUAL(stats[Stage::Detect].count, 5);
+	// The JSON resource without metadata is opened by the jsonresource reader, which fails
+	BOOST_CHECK_EQUAL(stats[Stage::Open].count, 2);
+	BOOST_CHECK_EQUAL(stats[Stage::ReadRaw].count, 4);
+	BOOST_CHECK_EQUAL(stats[Stage::Convert].count, 4);
+	BOOST_CHECK_EQUAL(stats[Stage::Write].count, 1);
+	BOOST_CHECK_EQUAL(stats.fallbacks, 1);
+
+	for (const auto& stage : stats.stages) {
+		std::uint64_t count = 0;
+		for (auto bucket : stage.buckets) {
+			count += bucket;
+		}
+		BOOST_CHECK_EQUAL(count, stage.count);
+	}
+
+	BOOST_CHECK(reven::metadata::StageStats::bucket_bound(0) == std::chrono::microseconds(1));
+	BOOST_CHECK(reven::metadata::StageStats::bucket_bound(1) == std::chrono::microseconds(4));
+	BOOST_CHECK(reven::metadata::StageStats::bucket_bound(reven::metadata::StageStats::bucket_count - 1) ==
+	            std::chrono::nanoseconds::max());
+
+	std::ostringstream prometheus;
+	reven::metadata::write_stats_prometheus(prometheus, stats);
+	BOOST_CHECK(prometheus.str().find("# TYPE rvnmetadata_stage_duration_seconds histogram\n") != std::string::npos);
+	BOOST_CHECK(prometheus.str().find("rvnmetadata_stage_duration_seconds_bucket{stage=\"detect\",le=\"+Inf\"} 5\n") !=
+	            std::string::npos);
+	BOOST_CHECK(prometheus.str().find("rvnmetadata_stage_duration_seconds_count{stage=\"write\"} 1\n") !=
+	            std::string::npos);
+	BOOST_CHECK(prometheus.str().find("rvnmetadata_read_fallbacks_total 1\n") != std::string::npos);
+
+	std::ostringstream text;
+	reven::metadata::write_stats_text(text, stats);
+	BOOST_CHECK(text.str().find("read_raw") != std::string::npos);
+
+	std::ostringstream written;
+	reven::metadata::write_stats(written, stats, "prometheus");
+	BOOST_CHECK_EQUAL(written.str(), prometheus.str());
+	written.str("");
+	reven::metadata::write_stats(written, stats, "text");
+	BOOST_CHECK_EQUAL(written.str(), text.str());
+	BOOST_CHECK_THROW(reven::metadata::write_stats(written, stats, "xml"), reven::metadata::MetadataError);
+
+	reven::metadata::reset_metadata_stats();
+	BOOST_CHECK_EQUAL(reven::metadata::metadata_stats()[Stage::Detect].count, 0);
+
+	// A report enables the stats during its lifetime, and writes them on destruction
+	BOOST_CHECK_THROW(reven::metadata::StatsReport(written, "xml"), reven::metadata::MetadataError);
+	BOOST_CHECK(!reven::metadata::metadata_stats_enabled());
+
+	std::ostringstream reported;
+	{
+		reven::metadata::StatsReport report(reported, "prometheus");
+		BOOST_CHECK(reven::metadata::metadata_stats_enabled());
+		reven::metadata::from_resource(TEST_DATA "/binary/good.bin");
+	}
+	BOOST_CHECK(!reven::metadata::metadata_stats_enabled());
+	BOOST_CHECK(reported.str().find("rvnmetadata_stage_duration_seconds_count{stage=\"detect\"} 1\n") !=
+	            std::string::npos);
+
+	reven::metadata::reset_metadata_stats();
+}
+
 BOOST_AUTO_TEST_CASE(correspondence_resource_type_and_string)
 {
 	for (std::uint32_t type = static_cast<std::uint32_t>(ResourceType::_MinValue);
@@ -587,6 +1098,7 @@ BOOST_AUTO_TEST_CASE(unknown_resource_type_to_string)
 {
 	auto unknown_resource = static_cast<ResourceType>(static_cast<std::uint32_t>(ResourceType::_MaxValue) + 10);
 	BOOST_CHECK_THROW(reven::metadata::to_string(unknown_resource), reven::metadata::UnknownResourceError);
+	BOOST_CHECK_THROW(reven::metadata::to_string(static_cast<ResourceType>(0)), reven::metadata::UnknownResourceError);
 }
 
 BOOST_AUTO_TEST_CASE(known_resource_name_to_type)
@@ -608,6 +1120,13 @@ BOOST_AUTO_TEST_CASE(unknown_resource_name_to_type)
 {
 	std::string unknown_string_type("toto");
 	BOOST_CHECK_THROW(reven::metadata::to_resource_type(unknown_string_type), reven::metadata::UnknownResourceError);
+
+	// Names with the same size and first char as known ones
+	for (const char* name : {"", "trace_bim", "trace_bin_", "Trace_bin", "o"}) {
+		BOOST_CHECK_THROW(reven::metadata::to_resource_type(name), reven::metadata::UnknownResourceError);
+	}
+	BOOST_CHECK_THROW(reven::metadata::to_resource_type(std::experimental::string_view("block\0", 6)),
+	                  reven::metadata::UnknownResourceError);
 }
 
 BOOST_AUTO_TEST_CASE(custom_metadata)
@@ -652,7 +1171,8 @@ BOOST_AUTO_TEST_CASE(custom_metadata)
 
 	/* Test custom metadata format errors */
 
-	error_message = std::string("Custom metadata key \"") + unprintable_custom_key + "\" is not a printable string.";
+	error_message = std::string("Custom metadata key \"") + unprintable_custom_key
+	                + "\" is not a printable string: invalid character at offset 0.";
 	BOOST_CHECK_EXCEPTION(
 		Metadata md(
 			ResourceType::KernelDescription,
@@ -666,7 +1186,8 @@ BOOST_AUTO_TEST_CASE(custom_metadata)
 		check_metadata_error_message
 	);
 
-	error_message = std::string("Custom metadata key \"") + invalid_custom_key + "\" must not contain a \'.\' char.";
+	error_message = std::string("Custom metadata key \"") + invalid_custom_key
+	                + "\" must not contain a \'.\' char: found at offset 7.";
 	BOOST_CHECK_EXCEPTION(
 		Metadata md(
 			ResourceType::KernelDescription,
@@ -681,7 +1202,7 @@ BOOST_AUTO_TEST_CASE(custom_metadata)
 	);
 
 	error_message = std::string("Custom metadata value \"") + unprintable_custom_value
-	                + "\" is not a printable string.";
+	                + "\" is not a printable string: invalid character at offset 0.";
 	BOOST_CHECK_EXCEPTION(
 		Metadata md(
 			ResourceType::KernelDescription,
@@ -695,3 +1216,577 @@ BOOST_AUTO_TEST_CASE(custom_metadata)
 		check_metadata_error_message
 	);
 }
+
+BOOST_AUTO_TEST_CASE(metadata_builder)
+{
+	reven::metadata::CustomMetadata custom_metadata;
+	for (unsigned i = 0; i < 1000; ++i) {
+		custom_metadata.emplace("a custom metadata key " + std::to_string(i),
+		                        "a custom metadata value long enough to be allocated " + std::to_string(i));
+	}
+
+	const std::string tool_name = "a tool name long enough to be allocated";
+	const std::string new_tool_name = "another tool name long enough to be allocated";
+
+	std::size_t allocations;
+	{
+		// The custom metadata are moved in
+		auto custom_copy = custom_metadata;
+		allocation_counter counter;
+		Metadata md(ResourceType::KernelDescription, Version(1, 2, 3), tool_name, Version(3, 2, 1), "Test v1",
+		            std::move(custom_copy));
+		allocations = counter.count();
+		BOOST_CHECK(md.custom_metadata() == custom_metadata);
+	}
+	BOOST_CHECK_LE(allocations, 2);
+
+	Metadata md(ResourceType::KernelDescription, Version(1, 2, 3), tool_name, Version(3, 2, 1), "Test v1",
+	            custom_metadata);
+
+	{
+		// Updating a field costs its own allocations only
+		allocation_counter counter;
+		md = reven::metadata::MetadataBuilder(std::move(md))
+			.tool_name(new_tool_name)
+			.custom("a custom metadata key 42", "a new value")
+			.custom("key", "value")
+			.build();
+		allocations = counter.count();
+	}
+	BOOST_CHECK_LE(allocations, 4);
+
+	BOOST_CHECK(md.type() == ResourceType::KernelDescription);
+	BOOST_CHECK(md.format_version() == Version(1, 2, 3));
+	BOOST_CHECK(md.tool_name() == new_tool_name);
+	BOOST_CHECK(md.tool_version() == Version(3, 2, 1));
+	BOOST_CHECK(md.tool_info() == "Test v1");
+	BOOST_CHECK_EQUAL(md.custom_metadata().size(), 1001);
+	BOOST_CHECK(md.custom_metadata().at("a custom metadata key 42") == "a new value");
+	BOOST_CHECK(md.custom_metadata().at("key") == "value");
+
+	// The fields are checked like in the constructor
+	reven::metadata::MetadataBuilder builder(md);
+	BOOST_CHECK_THROW(builder.type(static_cast<ResourceType>(0)), reven::metadata::UnknownMetadataTypeError);
+	BOOST_CHECK_THROW(builder.custom("invalid.key", "value"), reven::metadata::MetadataError);
+	BOOST_CHECK_THROW(builder.custom("key", "\x01"), reven::metadata::MetadataError);
+	BOOST_CHECK(builder.type(ResourceType::Strings).build().type() == ResourceType::Strings);
+}
+
+BOOST_AUTO_TEST_CASE(custom_metadata_container)
+{
+	using reven::metadata::CustomMetadata;
+
+	CustomMetadata custom{{"b", "2"}, {"c", "3"}, {"a", "1"}, {"b", "duplicate"}};
+	BOOST_REQUIRE_EQUAL(custom.size(), 3);
+
+	// Sorted by key, whatever the insertion order
+	std::vector<std::pair<std::string, std::string>> entries(custom.begin(), custom.end());
+	BOOST_CHECK(entries == (std::vector<std::pair<std::string, std::string>>{{"a", "1"}, {"b", "2"}, {"c", "3"}}));
+
+	BOOST_CHECK(custom.find("b") != custom.end());
+	BOOST_CHECK(custom.find("d") == custom.end());
+	BOOST_CHECK_EQUAL(custom.count("a"), 1);
+	BOOST_CHECK_EQUAL(custom.count(""), 0);
+	BOOST_CHECK(custom.at("c") == "3");
+	BOOST_CHECK_THROW(custom.at("d"), std::out_of_range);
+
+	BOOST_CHECK(!custom.emplace("a", "other").second);
+	BOOST_CHECK(custom.at("a") == "1");
+	BOOST_CHECK(custom.emplace("0", "0").second);
+	BOOST_CHECK(custom.emplace("z", "26").second);
+	BOOST_CHECK(!custom.insert_or_assign("a", "other").second);
+	BOOST_CHECK(custom.at("a") == "other");
+	custom["bb"] = "22";
+	custom["c"] += "3";
+
+	entries.assign(custom.begin(), custom.end());
+	BOOST_CHECK(entries == (std::vector<std::pair<std::string, std::string>>{
+		{"0", "0"}, {"a", "other"}, {"b", "2"}, {"bb", "22"}, {"c", "33"}, {"z", "26"}
+	}));
+
+	BOOST_CHECK_EQUAL(custom.erase("bb"), 1);
+	BOOST_CHECK_EQUAL(custom.erase("bb"), 0);
+	BOOST_CHECK_EQUAL(custom.size(), 5);
+
+	// Conversion from and to the former std::unordered_map representation
+	const auto map = static_cast<std::unordered_map<std::string, std::string>>(custom);
+	BOOST_CHECK_EQUAL(map.size(), 5);
+	BOOST_CHECK(map.at("z") == "26");
+	BOOST_CHECK(CustomMetadata(map) == custom);
+	BOOST_CHECK(CustomMetadata(map) != CustomMetadata{});
+
+	// Keys of every size, differing by a single byte from the looked up ones
+	for (std::size_t count : {2, 40}) {
+		CustomMetadata keys;
+		for (std::size_t size = 0; size < count; ++size) {
+			keys.emplace(std::string(size, 'k'), std::to_string(size));
+		}
+		for (std::size_t size = 0; size < count; ++size) {
+			const std::string key(size, 'k');
+			BOOST_REQUIRE(keys.find(key) != keys.end());
+			BOOST_CHECK_EQUAL(keys.find(key)->second, std::to_string(size));
+			for (std::size_t i = 0; i < size; ++i) {
+				auto other = key;
+				other[i] = 'x';
+				BOOST_CHECK(keys.find(other) == keys.end());
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(packed_custom_metadata)
+{
+	using reven::metadata::CustomMetadata;
+	using reven::metadata::PackedCustomMetadata;
+
+	const CustomMetadata custom{{"b", "2"}, {"c", std::string(100, 'c')}, {"a", ""}, {"", "empty key"}};
+
+	auto packed = std::unique_ptr<PackedCustomMetadata>(new PackedCustomMetadata(custom));
+	BOOST_CHECK_EQUAL(packed->size(), 4);
+	BOOST_CHECK(static_cast<CustomMetadata>(*packed) == custom);
+	BOOST_CHECK(packed->at("c") == std::string(100, 'c'));
+	BOOST_CHECK(packed->at("") == "empty key");
+	BOOST_CHECK(packed->at("a").empty());
+	BOOST_CHECK_EQUAL(packed->count("b"), 1);
+	BOOST_CHECK(packed->find("d") == packed->end());
+	BOOST_CHECK_THROW(packed->at("d"), std::out_of_range);
+
+	// The copies don't refer to the buffer of the original
+	const auto copy = *packed;
+	PackedCustomMetadata assigned;
+	assigned = copy;
+	const PackedCustomMetadata moved(std::move(*packed));
+	packed.reset();
+
+	for (const auto& other : {copy, assigned, moved}) {
+		BOOST_CHECK(static_cast<CustomMetadata>(other) == custom);
+		BOOST_CHECK(other == copy);
+	}
+	BOOST_CHECK(PackedCustomMetadata() != copy);
+	BOOST_CHECK(PackedCustomMetadata(CustomMetadata{}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(custom_metadata_validation)
+{
+	namespace validate = reven::metadata::validate;
+
+	std::vector<validate::ScanFunction> scan_functions{validate::scan_scalar, validate::scan};
+	if (validate::scan_sse2()) {
+		scan_functions.push_back(validate::scan_sse2());
+	}
+	if (validate::scan_avx2()) {
+		scan_functions.push_back(validate::scan_avx2());
+	}
+
+	// Reference implementation
+	auto expected_scan = [](const std::string& str) {
+		validate::ScanResult result{validate::ScanResult::npos, validate::ScanResult::npos};
+		for (std::size_t i = 0; i < str.size(); ++i) {
+			const auto c = static_cast<unsigned char>(str[i]);
+			if (c < 0x20 || c > 0x7e) {
+				result.first_unprintable = i;
+				break;
+			}
+			if (c == '.' && result.first_dot == validate::ScanResult::npos) {
+				result.first_dot = i;
+			}
+		}
+		return result;
+	};
+
+	std::mt19937 generator(42);
+	for (unsigned i = 0; i < 20000; ++i) {
+		// Mostly printable strings with a few dots and invalid characters, across several vector sizes
+		std::string str(generator() % 100, 'a');
+		for (auto& c : str) {
+			const auto kind = generator() % 64;
+			if (kind == 0) {
+				c = '.';
+			} else if (kind == 1) {
+				c = static_cast<char>(generator() % 256);
+			} else {
+				c = static_cast<char>(0x20 + generator() % 0x5f);
+			}
+		}
+
+		const auto expected = expected_scan(str);
+		for (const auto scan : scan_functions) {
+			const auto result = scan(str.data(), str.size());
+			BOOST_REQUIRE_EQUAL(result.first_unprintable, expected.first_unprintable);
+			BOOST_REQUIRE_EQUAL(result.first_dot, expected.first_dot);
+		}
+	}
+
+	// The offset is reported in the error
+	const std::string long_value = std::string(1000, 'x') + "\n";
+	BOOST_CHECK_EXCEPTION(
+		Metadata(ResourceType::KernelDescription, Version(1), "dummy", Version(1), "Test v1", {{"key", long_value}}),
+		reven::metadata::MetadataError,
+		[](const reven::metadata::MetadataError& e) {
+			return std::string(e.what()).find("invalid character at offset 1000.") != std::string::npos;
+		}
+	);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_view)
+{
+	Metadata md(
+		ResourceType::KernelDescription,
+		Version(1, 2, 3, {{"foo"}}, {}),
+		"TestJsonMetadataWriter", Version(3, 2, 1), "Test v1",
+		reven::metadata::CustomMetadata{{"key", "value"}},
+		std::chrono::system_clock::time_point{std::chrono::seconds(42424242)}
+	);
+
+	auto jmd = to_json_raw_metadata(md);
+	auto view = reven::metadata::view_raw_metadata(jmd);
+
+	// The strings are borrowed from the raw metadata
+	allocation_counter counter;
+	BOOST_CHECK(view.type() == ResourceType::KernelDescription);
+	BOOST_CHECK(view.tool_name() == "TestJsonMetadataWriter");
+	BOOST_CHECK(view.tool_info() == "Test v1");
+	BOOST_CHECK(view.format_version_string() == "1.2.3-foo");
+	BOOST_CHECK(view.tool_name().data() == jmd.tool_name().data());
+	BOOST_CHECK(view.generation_date() == md.generation_date());
+	BOOST_CHECK_EQUAL(counter.count(), 0);
+
+	// The versions are parsed once
+	const Version* format_version = &view.format_version();
+	BOOST_CHECK(check_version_strict_equality(*format_version, md.format_version()));
+	BOOST_CHECK(&view.format_version() == format_version);
+	BOOST_CHECK(check_version_strict_equality(view.tool_version(), md.tool_version()));
+
+	BOOST_CHECK(view.custom_metadata() == md.custom_metadata());
+
+	auto md2 = view.to_metadata();
+	BOOST_CHECK(md2.type() == md.type());
+	BOOST_CHECK(check_version_strict_equality(md2.format_version(), md.format_version()));
+	BOOST_CHECK(md2.tool_name() == md.tool_name());
+	BOOST_CHECK(check_version_strict_equality(md2.tool_version(), md.tool_version()));
+	BOOST_CHECK(md2.tool_info() == md.tool_info());
+	BOOST_CHECK(md2.generation_date() == md.generation_date());
+	BOOST_CHECK(md2.custom_metadata() == md.custom_metadata());
+
+	// Without custom metadata
+	auto bmd = to_bin_raw_metadata(Metadata(ResourceType::KernelDescription, Version(1, 0, 0), "tool",
+	                                        Version(1, 0, 0), "info"));
+	BOOST_CHECK(reven::metadata::view_raw_metadata(bmd).custom_metadata().empty());
+
+	// Errors are only raised when the invalid field is accessed
+	reven::metadata::MetadataView bad_view(0xffff, "not a version", "tool", "1.0.0", "info", 0);
+	BOOST_CHECK(bad_view.tool_name() == "tool");
+	BOOST_CHECK_THROW(bad_view.type(), reven::metadata::UnknownMetadataTypeError);
+	BOOST_CHECK_THROW(bad_view.format_version(), reven::metadata::MetadataError);
+	BOOST_CHECK_THROW(bad_view.to_metadata(), reven::metadata::MetadataError);
+
+	// The custom metadata are borrowed, so a temporary range is rejected
+	using Custom = std::vector<std::pair<std::string, std::string>>;
+	using reven::metadata::MetadataView;
+	static_assert(std::is_constructible<MetadataView, std::uint32_t, const char*, const char*, const char*, const char*,
+	                                    std::uint64_t, const Custom&>::value, "");
+	static_assert(!std::is_constructible<MetadataView, std::uint32_t, const char*, const char*, const char*, const char*,
+	                                     std::uint64_t, Custom&&>::value, "");
+}
+
+BOOST_AUTO_TEST_CASE(view_resource)
+{
+	ResourceType type = ResourceType::_MinValue;
+	reven::metadata::view_resource(TEST_DATA "/json/good.json", [&](const reven::metadata::MetadataView& view) {
+		type = view.type();
+	});
+	BOOST_CHECK(type == ResourceType::KernelDescription);
+
+	BOOST_CHECK_THROW(reven::metadata::view_resource(TEST_DATA "/json/without_metadata.json",
+	                                                 [](const reven::metadata::MetadataView&) {}),
+	                  reven::metadata::ReadMetadataError);
+
+	// The type is only checked if the visitor asks for it
+	bool visited = false;
+	reven::metadata::view_resource(TEST_DATA "/binary/wrong_type.bin", [&](const reven::metadata::MetadataView& view) {
+		visited = true;
+		BOOST_CHECK_THROW(view.type(), reven::metadata::UnknownMetadataTypeError);
+	});
+	BOOST_CHECK(visited);
+}
+
+BOOST_AUTO_TEST_CASE(view_resource_fields)
+{
+	using reven::metadata::MetadataFields;
+	using reven::metadata::MetadataView;
+
+	for (const char* filename : {TEST_DATA "/binary/good.bin", TEST_DATA "/binary/outdated.bin",
+	                             TEST_DATA "/json/good.json", TEST_DATA "/sqlite/good.sqlite"}) {
+		const auto md = reven::metadata::from_resource(filename);
+
+		reven::metadata::view_resource(filename, MetadataFields::Type, [&](const MetadataView& view) {
+			BOOST_CHECK(view.type() == md.type());
+			BOOST_CHECK(has_fields(view.fields(), MetadataFields::Type));
+		});
+
+		reven::metadata::view_resource(filename, MetadataFields::ToolName | MetadataFields::ToolVersion,
+		                               [&](const MetadataView& view) {
+			BOOST_CHECK(view.tool_name() == md.tool_name());
+			BOOST_CHECK(check_version_strict_equality(view.tool_version(), md.tool_version()));
+		});
+	}
+
+	// The fields that are not requested are not read
+	reven::metadata::view_resource(TEST_DATA "/sqlite/good.sqlite", MetadataFields::Type, [](const MetadataView& view) {
+		BOOST_CHECK(view.fields() == MetadataFields::Type);
+		BOOST_CHECK_THROW(view.tool_name(), std::logic_error);
+	});
+	reven::metadata::view_resource(TEST_DATA "/json/good.json", MetadataFields::Type, [](const MetadataView& view) {
+		BOOST_CHECK(!has_fields(view.fields(), MetadataFields::Custom));
+		BOOST_CHECK_THROW(view.custom_metadata(), std::logic_error);
+	});
+
+	// A view with only some fields
+	const auto type_view = MetadataView::from_type(static_cast<std::uint32_t>(ResourceType::TraceBin));
+	BOOST_CHECK(type_view.fields() == MetadataFields::Type);
+	BOOST_CHECK(type_view.type() == ResourceType::TraceBin);
+	BOOST_CHECK_THROW(type_view.tool_name(), std::logic_error);
+	BOOST_CHECK_THROW(type_view.format_version(), std::logic_error);
+	BOOST_CHECK_THROW(type_view.to_metadata(), std::logic_error);
+
+	reven::metadata::view_resource(TEST_DATA "/binary/wrong_type.bin", MetadataFields::Type,
+	                               [](const MetadataView& view) {
+		BOOST_CHECK_THROW(view.type(), reven::metadata::UnknownMetadataTypeError);
+	});
+
+	BOOST_CHECK_THROW(reven::metadata::view_resource(TEST_DATA "/binary/without_metadata.bin", MetadataFields::Type,
+	                                                 [](const MetadataView&) {}),
+	                  reven::metadata::ReadMetadataError);
+}
+
+BOOST_AUTO_TEST_CASE(binary_header_metadata)
+{
+	for (const char* filename : {TEST_DATA "/binary/good.bin", TEST_DATA "/binary/outdated.bin",
+	                             TEST_DATA "/binary/wrong_type.bin"}) {
+		std::ifstream file(filename, std::ios::binary);
+		const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		const auto reader = reven::binresource::Reader::open(filename);
+		const auto& raw_md = reader.metadata();
+
+		std::size_t header_size = 0;
+		const auto view = reven::metadata::binheader::view(data.data(), data.size(), header_size);
+		BOOST_REQUIRE(view);
+		BOOST_CHECK_EQUAL(header_size, data.compare(0, 8, reven::metadata::binheader::magic) == 0
+		                               ? reven::metadata::binheader::header_size
+		                               : reven::metadata::binheader::legacy_header_size);
+		if (raw_md.type() <= static_cast<std::uint32_t>(ResourceType::_MaxValue)) {
+			BOOST_CHECK_EQUAL(static_cast<std::uint32_t>(view->type()), raw_md.type());
+		} else {
+			BOOST_CHECK_THROW(view->type(), reven::metadata::UnknownMetadataTypeError);
+		}
+		BOOST_CHECK(view->format_version_string() == raw_md.format_version());
+		BOOST_CHECK(view->tool_name() == raw_md.tool_name());
+		BOOST_CHECK(view->tool_version_string() == raw_md.tool_version());
+		BOOST_CHECK(view->tool_info() == raw_md.tool_info());
+		BOOST_CHECK(view->generation_date() ==
+		            std::chrono::system_clock::time_point{std::chrono::seconds(raw_md.generation_date())});
+
+		// Truncated header
+		BOOST_CHECK(!reven::metadata::binheader::view(data.data(), 0xc00, header_size));
+	}
+
+	std::ifstream file(TEST_DATA "/binary/good.bin", std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	std::size_t header_size = 0;
+
+	// String longer than its buffer
+	auto corrupted = data;
+	corrupted[0x219] = 0x10;
+	BOOST_CHECK(!reven::metadata::binheader::view(corrupted.data(), corrupted.size(), header_size));
+
+	// Unknown metadata version
+	corrupted = data;
+	corrupted[8] = 2;
+	BOOST_CHECK(!reven::metadata::binheader::view(corrupted.data(), corrupted.size(), header_size));
+
+	// Without the magic
+	BOOST_CHECK(!reven::metadata::binheader::view(data.data() + 1, data.size() - 1, header_size));
+}
+
+BOOST_AUTO_TEST_CASE(json_streaming_metadata)
+{
+	namespace jsonstream = reven::metadata::jsonstream;
+	using reven::metadata::MetadataFields;
+
+	// Same results and errors as the jsonresource reader
+	for (const char* filename : {TEST_DATA "/json/good.json", TEST_DATA "/json/incompatible.json",
+	                             TEST_DATA "/json/without_metadata.json", TEST_DATA "/json/wrong_type.json"}) {
+		boost::optional<reven::jsonresource::Metadata> raw_md;
+		try {
+			raw_md = reven::jsonresource::Reader::open(filename).metadata();
+		} catch (const std::exception&) {
+		}
+
+		jsonstream::JsonMetadata md;
+		const bool extracted = jsonstream::extract(filename, nullptr, 0, MetadataFields::All, md);
+		BOOST_CHECK_EQUAL(extracted, static_cast<bool>(raw_md));
+		if (!extracted || !raw_md) {
+			continue;
+		}
+
+		BOOST_CHECK_EQUAL(md.type, raw_md->type());
+		BOOST_CHECK_EQUAL(md.format_version, raw_md->format_version());
+		BOOST_CHECK_EQUAL(md.tool_name, raw_md->tool_name());
+		BOOST_CHECK_EQUAL(md.tool_version, raw_md->tool_version());
+		BOOST_CHECK_EQUAL(md.tool_info, raw_md->tool_info());
+		BOOST_CHECK_EQUAL(md.generation_date, raw_md->generation_date());
+		BOOST_CHECK(md.custom_metadata.empty());
+	}
+
+	transient_directory tmp_dir{};
+	const auto write_file = [&](const std::string& name, const std::string& content) {
+		const auto path = (tmp_dir.path / name).string();
+		std::ofstream file(path, std::ios::binary);
+		file << content;
+		return path;
+	};
+
+	const std::string metadata = R"({"metadata_version": "1", "type": "8", "format_version": "1.0.0",
+		"tool_name": "to\"olé😀", "tool_version": "2.0.0", "tool_info": "info\n",
+		"generation_date": "42", "other": [1, -2.5e3, true, null, {"a": []}],
+		"custom": {"key": "value", "other_key": "other value"}})";
+
+	// The metadata after other values, and followed by a large payload that is tokenized but not kept
+	std::string payload;
+	for (unsigned i = 0; i < (1 << 18); ++i) {
+		payload += "[0.5, \"a\"],";
+	}
+	const auto path = write_file("large.json", R"({"data": {"values": [1, 2, "3"]}, "metadata": )" + metadata +
+	                                           ", \"payload\": [" + payload + "{}]}\n");
+
+	jsonstream::JsonMetadata md;
+	BOOST_REQUIRE(jsonstream::extract(path.c_str(), nullptr, 0, MetadataFields::All, md));
+	BOOST_CHECK_EQUAL(md.type, 8);
+	BOOST_CHECK_EQUAL(md.tool_name, "to\"ol\xc3\xa9\xf0\x9f\x98\x80");
+	BOOST_CHECK_EQUAL(md.tool_info, "info\n");
+	BOOST_CHECK_EQUAL(md.generation_date, 42);
+	BOOST_CHECK_EQUAL(md.bytes_read, boost::filesystem::file_size(path));
+	BOOST_CHECK(md.view().custom_metadata() ==
+	            reven::metadata::CustomMetadata({{"key", "value"}, {"other_key", "other value"}}));
+
+	// The custom metadata are not kept when they are not requested, but they are still checked
+	jsonstream::JsonMetadata type_md;
+	BOOST_REQUIRE(jsonstream::extract(path.c_str(), nullptr, 0, MetadataFields::Type, type_md));
+	BOOST_CHECK_EQUAL(type_md.type, 8);
+	BOOST_CHECK(type_md.custom_metadata.empty());
+	BOOST_CHECK(type_md.view().fields() == ~MetadataFields::Custom);
+	BOOST_CHECK_THROW(type_md.view().custom_metadata(), std::logic_error);
+
+	const auto unchecked_path = write_file("unchecked.json", R"({"metadata": {"metadata_version": "1", "type": "8",
+		"format_version": "1.0.0", "tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1",
+		"custom": {"key": 1, "other_key": ["not", "a", "string"]}}})");
+	for (const auto wanted : {MetadataFields::Type, MetadataFields::All}) {
+		jsonstream::JsonMetadata unchecked_md;
+		BOOST_CHECK(!jsonstream::extract(unchecked_path.c_str(), nullptr, 0, wanted, unchecked_md));
+	}
+
+	// The first bytes can be given to avoid reading them again: they are not read from the file
+	const std::string prefix = R"({"metadata": {"metadata_version": "1", "type": "8", "format_ver)";
+	const auto prefixed_path = write_file("prefix.json", std::string(prefix.size(), 'x') + R"(sion": "1.2.3",
+		"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1"}})");
+	jsonstream::JsonMetadata prefixed_md;
+	BOOST_REQUIRE(jsonstream::extract(prefixed_path.c_str(), prefix.data(), prefix.size(), MetadataFields::All,
+	                                  prefixed_md));
+	BOOST_CHECK_EQUAL(prefixed_md.format_version, "1.2.3");
+
+	// Left to the jsonresource reader
+	for (const std::string& content : {
+		std::string(R"({"metadata": {"metadata_version": "1"}})"),
+		std::string(R"({"metadata": {"metadata_version": "2", "type": "8", "format_version": "1.0.0",
+			"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1"}})"),
+		std::string(R"({"metadata": {"metadata_version": "1", "type": "-8", "format_version": "1.0.0",
+			"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1"}})"),
+		std::string(R"({"metadata": {"metadata_version": "1", "type": "8", "type": "8", "format_version": "1.0.0",
+			"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1"}})"),
+		std::string(R"({"metadata": {"metadata_version": "1", "type": 8, "format_version": "1.0.0",
+			"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1"}})"),
+		std::string(R"({"metadata": {"metadata_version": "1", "type": "8", "format_version": "1.0.0",
+			"tool_name": "n", "tool_version": "1.0.0", "tool_info": "i", "generation_date": "1",
+			"custom": {"a": "1", "a": "2"}}})"),
+		std::string(R"({"data": [01], "metadata": {}})"),
+		std::string(R"({"metadata": {"metadata_version": "1")"),
+		std::string("[]"),
+		// Truncated or ill-formed after the metadata
+		R"({"metadata": )" + metadata + R"(, "payload": [1, 2)",
+		R"({"metadata": )" + metadata + "\n",
+		R"({"metadata": )" + metadata + R"(, "payload": [[ not json}})",
+		R"({"metadata": )" + metadata + R"(, "payload": [1, 2,]})",
+		R"({"metadata": )" + metadata + "} {}",
+		R"({"metadata": )" + metadata + ", \"metadata\": " + metadata + "}",
+		// Not UTF-8: a lone continuation byte, an overlong '/', an encoded surrogate
+		R"({"metadata": )" + metadata + ", \"payload\": \"\x80\"}",
+		R"({"metadata": )" + metadata + ", \"payload\": \"\xc0\xaf\"}",
+		R"({"metadata": )" + metadata + ", \"payload\": \"\xed\xa0\x80\"}",
+	}) {
+		jsonstream::JsonMetadata ignored;
+		BOOST_CHECK_MESSAGE(!jsonstream::extract(write_file("bad.json", content).c_str(), nullptr, 0,
+		                                         MetadataFields::All, ignored), content);
+	}
+
+	// A truncated or ill-formed document is still an error for from_resource, as with the jsonresource reader
+	BOOST_CHECK_THROW(reven::metadata::from_resource(write_file("truncated.json", R"({"metadata": )" + metadata +
+	                                                            R"(, "payload": [1, 2)").c_str()),
+	                  reven::metadata::ReadMetadataError);
+	BOOST_CHECK_THROW(reven::metadata::from_resource(write_file("ill_formed.json", R"({"metadata": )" + metadata +
+	                                                            R"(, "payload": [[ not json}})").c_str()),
+	                  reven::metadata::ReadMetadataError);
+	BOOST_CHECK_EQUAL(reven::metadata::from_resource(write_file("complete.json", R"({"metadata": )" + metadata +
+	                                                            R"(, "payload": [1, 2]})").c_str()).tool_info(),
+	                  "info\n");
+}
+
+BOOST_AUTO_TEST_CASE(sqlite_read_only_metadata)
+{
+	namespace sqlreader = reven::metadata::sqlreader;
+	using reven::metadata::MetadataFields;
+
+	// Same results as the rvnsqlite reader, the other resources are left to it
+	for (const char* filename : {TEST_DATA "/sqlite/good.sqlite", TEST_DATA "/sqlite/wrong_type.sqlite"}) {
+		const auto rdb = reven::sqlite::ResourceDatabase::open(filename);
+		const auto& raw_md = rdb.metadata();
+
+		sqlreader::SqlMetadata md;
+		BOOST_REQUIRE(sqlreader::read(filename, MetadataFields::All, md));
+		BOOST_CHECK_EQUAL(md.type, raw_md.type());
+		BOOST_CHECK_EQUAL(md.format_version, raw_md.format_version());
+		BOOST_CHECK_EQUAL(md.tool_name, raw_md.tool_name());
+		BOOST_CHECK_EQUAL(md.tool_version, raw_md.tool_version());
+		BOOST_CHECK_EQUAL(md.tool_info, raw_md.tool_info());
+		BOOST_CHECK_EQUAL(md.generation_date, raw_md.generation_date());
+		BOOST_CHECK(md.view().fields() == MetadataFields::All);
+		BOOST_CHECK(md.bytes_read > 0);
+		BOOST_CHECK(md.bytes_read <= boost::filesystem::file_size(filename));
+
+		// Only the type is selected when it is the only requested field
+		sqlreader::SqlMetadata type_md;
+		BOOST_REQUIRE(sqlreader::read(filename, MetadataFields::Type, type_md));
+		BOOST_CHECK_EQUAL(type_md.type, raw_md.type());
+		BOOST_CHECK(type_md.tool_name.empty());
+		BOOST_CHECK(type_md.view().fields() == MetadataFields::Type);
+		BOOST_CHECK_THROW(type_md.view().tool_name(), std::logic_error);
+	}
+
+	for (const char* filename : {TEST_DATA "/sqlite/outdated.sqlite", TEST_DATA "/sqlite/without_metadata.sqlite",
+	                             TEST_DATA "/sqlite/missing.sqlite"}) {
+		sqlreader::SqlMetadata md;
+		BOOST_CHECK(!sqlreader::read(filename, MetadataFields::All, md));
+	}
+
+	// Not read while there is a journal
+	transient_directory tmp_dir{};
+	const auto tmp_file = tmp_dir.path / "good?#%.sqlite";
+	boost::filesystem::copy_file(TEST_DATA "/sqlite/good.sqlite", tmp_file);
+
+	sqlreader::SqlMetadata md;
+	BOOST_CHECK(sqlreader::read(tmp_file.c_str(), MetadataFields::All, md));
+
+	std::ofstream(tmp_file.string() + "-journal");
+	BOOST_CHECK(!sqlreader::read(tmp_file.c_str(), MetadataFields::All, md));
+	BOOST_CHECK(reven::metadata::from_resource(tmp_file.c_str()).type() == ResourceType::MemHist);
+}
@@ -0,0 +1,240 @@
+#define BOOST_TEST_MODULE RVN_METADATA_PERFORMANCE
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "allocation_counter.h"
+
+#include <metadata-common.h>
+#include <metadata-file.h>
+
+// Compares the cost of the hot paths with the baseline in PERFORMANCE_BASELINE:
+//  * the number of allocations of an operation must not exceed the one of the baseline. It may be lower, as it
+//    depends on the standard library and on the versions of libmagic and sqlite.
+//  * the time of an operation is measured relative to a reference workload run on the same machine, and must not
+//    exceed the one of the baseline by more than its tolerance. These checks are skipped in unoptimized builds.
+// After an intended change, write a new baseline with UPDATE_PERFORMANCE_BASELINE=FILE test_performance, then review
+// it and copy it over PERFORMANCE_BASELINE. The source tree is never written by the test.
+
+using reven::metadata::MetadataFields;
+using reven::metadata::MetadataView;
+using reven::metadata::Version;
+
+namespace {
+
+// Tolerance of the new entries of the baseline: an operation may be up to 50% slower than in the baseline
+constexpr double default_tolerance = 0.5;
+
+// The median of these measures is kept
+constexpr std::size_t repetitions = 11;
+
+// Minimum duration of a timed batch of operations, for the clock resolution not to matter
+constexpr std::chrono::microseconds min_batch_duration{2000};
+
+struct BaselineEntry {
+	std::size_t allocations;
+	double relative_time;
+	double tolerance;
+};
+
+///
+/// Baseline file, with one "name allocations relative_time tolerance" entry per line and '#' comments
+///
+class Baseline {
+public:
+	static Baseline load(const char* filename) {
+		Baseline baseline;
+
+		std::ifstream file(filename);
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			std::istringstream stream(line);
+			std::string name;
+			BaselineEntry entry;
+			if (stream >> name >> entry.allocations >> entry.relative_time >> entry.tolerance) {
+				baseline.entries_[name] = entry;
+			}
+		}
+
+		return baseline;
+	}
+
+	const BaselineEntry* find(const std::string& name) const {
+		const auto it = entries_.find(name);
+		return it == entries_.end() ? nullptr : &it->second;
+	}
+
+	// Set the measure of an entry, keeping its tolerance if it already exists
+	void update(const std::string& name, std::size_t allocations, double relative_time) {
+		const auto it = entries_.find(name);
+		const double tolerance = it == entries_.end() ? default_tolerance : it->second.tolerance;
+		entries_[name] = {allocations, relative_time, tolerance};
+	}
+
+	void save(const char* filename) const {
+		std::ofstream file(filename, std::ios::trunc);
+		file << "# Baseline of test_performance, regenerate with UPDATE_PERFORMANCE_BASELINE=FILE test_performance\n"
+		     << "# name allocations relative_time tolerance\n";
+		for (const auto& entry : entries_) {
+			file << entry.first << " " << entry.second.allocations << " " << entry.second.relative_time << " "
+			     << entry.second.tolerance << "\n";
+		}
+	}
+
+private:
+	std::map<std::string, BaselineEntry> entries_;
+};
+
+// Baseline shared by the test cases, so the updated one accumulates their measures
+Baseline& baseline() {
+	static Baseline baseline = Baseline::load(PERFORMANCE_BASELINE);
+	return baseline;
+}
+
+// File the updated baseline is written to, or nullptr to compare with the baseline
+const char* updated_baseline_file() {
+	const char* file = std::getenv("UPDATE_PERFORMANCE_BASELINE");
+	return file != nullptr && *file != '\0' ? file : nullptr;
+}
+
+// Workload the operations are timed against: small allocations, copies and comparisons, like most hot paths
+std::size_t reference_workload() {
+	static const std::vector<std::string> strings = [] {
+		std::vector<std::string> strings;
+		for (std::size_t i = 0; i < 32; ++i) {
+			strings.push_back("reference string number " + std::to_string(i * 7919 % 1000));
+		}
+		return strings;
+	}();
+
+	auto copy = strings;
+	std::sort(copy.begin(), copy.end());
+	return copy.front().size();
+}
+
+// Time per call of `fn`, run in a batch long enough to be measured
+template <typename Fn>
+double time_per_call(Fn fn, std::size_t& batch_size) {
+	// Written so the results can't be optimized away
+	static volatile std::size_t checksum = 0;
+
+	while (true) {
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < batch_size; ++i) {
+			checksum = checksum + fn();
+		}
+		const auto duration = std::chrono::steady_clock::now() - start;
+
+		if (duration >= min_batch_duration) {
+			return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count())
+			       / static_cast<double>(batch_size);
+		}
+		batch_size *= 2;
+	}
+}
+
+///
+/// Measure `fn`, which returns a non-zero value computed from its result, and compare it with its entry of the
+/// baseline, or update it
+///
+template <typename Fn>
+void check_performance(const std::string& name, Fn fn) {
+	// Warm-up, and the first call may allocate static data
+	BOOST_REQUIRE_NE(fn(), 0u);
+
+	std::size_t allocations;
+	{
+		allocation_counter counter;
+		fn();
+		allocations = counter.count();
+	}
+
+	// The reference is measured along each repetition, so both see the same frequency changes of the CPU
+	std::vector<double> ratios;
+	std::size_t reference_batch = 1;
+	std::size_t batch = 1;
+	for (std::size_t i = 0; i < repetitions; ++i) {
+		const double reference_time = time_per_call(reference_workload, reference_batch);
+		ratios.push_back(time_per_call(fn, batch) / reference_time);
+	}
+	std::nth_element(ratios.begin(), ratios.begin() + repetitions / 2, ratios.end());
+	const double relative_time = ratios[repetitions / 2];
+
+	if (const char* file = updated_baseline_file()) {
+		baseline().update(name, allocations, relative_time);
+		baseline().save(file);
+		return;
+	}
+
+	const auto entry = baseline().find(name);
+	if (entry == nullptr) {
+		BOOST_ERROR(name << " is not in the baseline, regenerate it with UPDATE_PERFORMANCE_BASELINE=FILE");
+		return;
+	}
+
+	BOOST_CHECK_MESSAGE(allocations <= entry->allocations,
+	                    name << " makes " << allocations << " allocations, more than " << entry->allocations);
+	if (allocations < entry->allocations) {
+		BOOST_TEST_MESSAGE(name << " makes " << allocations << " allocations, the baseline could be lowered from "
+		                   << entry->allocations);
+	}
+
+#if PERFORMANCE_CHECK_TIMES
+	const double limit = entry->relative_time * (1 + entry->tolerance);
+	BOOST_CHECK_MESSAGE(relative_time <= limit,
+	                    name << " takes " << relative_time << " times the reference workload, more than " << limit
+	                    << " (" << entry->relative_time << " in the baseline)");
+#endif
+	BOOST_TEST_MESSAGE(name << ": " << allocations << " allocations, " << relative_time << " x reference");
+}
+
+std::size_t read_type(const char* filename) {
+	std::size_t type = 0;
+	reven::metadata::view_resource(filename, MetadataFields::Type, [&](const MetadataView& view) {
+		type = static_cast<std::size_t>(view.type());
+	});
+	return type;
+}
+
+std::size_t read_metadata(const char* filename) {
+	return reven::metadata::from_resource(filename).tool_name().size();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(version_parse)
+{
+	check_performance("version_parse_release", [] {
+		return Version::from_string("1.2.3").patch();
+	});
+
+	check_performance("version_parse_prerelease_build", [] {
+		return Version::from_string("1.2.3-rc.1+build.4242").patch();
+	});
+}
+
+// Detection of the format, then read of the type only
+BOOST_AUTO_TEST_CASE(type_read)
+{
+	check_performance("type_read_binary", [] { return read_type(TEST_DATA "/binary/good.bin"); });
+	check_performance("type_read_json", [] { return read_type(TEST_DATA "/json/good.json"); });
+	check_performance("type_read_sqlite", [] { return read_type(TEST_DATA "/sqlite/good.sqlite"); });
+}
+
+BOOST_AUTO_TEST_CASE(metadata_read)
+{
+	check_performance("from_resource_binary", [] { return read_metadata(TEST_DATA "/binary/good.bin"); });
+	check_performance("from_resource_json", [] { return read_metadata(TEST_DATA "/json/good.json"); });
+	check_performance("from_resource_sqlite", [] { return read_metadata(TEST_DATA "/sqlite/good.sqlite"); });
+}
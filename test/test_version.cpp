@@ -1,8 +1,102 @@
 #define BOOST_TEST_MODULE RVN_METADATA_VERSION
 #include <boost/test/unit_test.hpp>
 
+#include <random>
+#include <regex>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
 #include "test_helpers.h"
 
+namespace {
+
+// Reference implementation of Version::from_string, based on a regex, used to check the hand-written parser
+Version regex_version_from_string(const std::string& str) {
+	auto identifiers_from_string = [](const std::string& str) {
+		std::vector<Version::Identifier> identifiers;
+		if (str.empty())
+			return identifiers;
+
+		std::vector<std::string> tokens;
+		boost::split(tokens, str, boost::is_any_of("."));
+
+		for (const auto& s : tokens) {
+			if (!s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return std::isdigit(c); })) {
+				if (s[0] == '0')
+					throw reven::metadata::MetadataError("Numeric identifier can't start with '0'");
+
+				identifiers.emplace_back(std::stoull(s));
+			} else {
+				identifiers.emplace_back(s);
+			}
+		}
+
+		return identifiers;
+	};
+
+	std::regex regex("^"
+	                 "(0|[1-9][0-9]*)"
+	                 "\\.(0|[1-9][0-9]*)"
+	                 "\\.(0|[1-9][0-9]*)"
+	                 "(?:\\-([0-9a-zA-Z-]+[\\.0-9a-zA-Z-]*))?"
+	                 "(?:\\+([0-9a-zA-Z-]+[\\.0-9a-zA-Z-]*))?"
+	                 "$" , std::regex_constants::ECMAScript
+	);
+
+	std::smatch result;
+	if (!std::regex_search(str, result, regex)) {
+		throw reven::metadata::MetadataError("The string version isn't correct");
+	}
+
+	auto major = std::stoull(result[1]);
+	auto minor = std::stoull(result[2]);
+	auto patch = std::stoull(result[3]);
+	auto prerelease = identifiers_from_string(result[4]);
+	auto build = identifiers_from_string(result[5]);
+
+	return Version(major, minor, patch, std::move(prerelease), std::move(build));
+}
+
+enum class ParseResult {
+	Ok,
+	MetadataError,
+	OutOfRange,
+};
+
+template <typename Parser>
+ParseResult parse(Parser parser, const std::string& str, Version& version) {
+	try {
+		version = parser(str);
+		return ParseResult::Ok;
+	} catch (const reven::metadata::MetadataError&) {
+		return ParseResult::MetadataError;
+	} catch (const std::out_of_range&) {
+		return ParseResult::OutOfRange;
+	}
+}
+
+bool check_same_as_regex(const std::string& str) {
+	Version expected(0), actual(0);
+
+	const auto expected_result = parse(regex_version_from_string, str, expected);
+	const auto actual_result = parse([](const std::string& s) { return Version::from_string(s); }, str, actual);
+
+	if (expected_result != actual_result) {
+		BOOST_TEST_MESSAGE("Different result when parsing \"" << str << "\"");
+		return false;
+	}
+
+	if (expected_result != ParseResult::Ok)
+		return true;
+
+	// A well-formed version is formatted back to the same string, with or without keeping it
+	return check_version_strict_equality(expected, actual) && actual.to_string() == str
+	       && Version::from_string(str, true).to_string() == str;
+}
+
+}
+
 bool check_comparison(const Version& a, const Version& b, bool compatible, const Version::Comparison& comparison) {
 	auto cmp = a.compare(b);
 
@@ -130,6 +224,44 @@ BOOST_AUTO_TEST_CASE(from_string)
 	BOOST_CHECK_THROW(Version::from_string("0.0.0+100000000000000000000000000"), std::out_of_range);
 }
 
+BOOST_AUTO_TEST_CASE(from_string_same_as_regex)
+{
+	const std::vector<std::string> versions {
+		"1.2.3", "0.0.0", "10.20.30", "1.2.3-foo", "1.2.3-foo-bar", "1.2.3-foo.bar.42", "1.2.3+foo.bar.42",
+		"1.2.3-foo.bar.42+foo.bar.42", "1.2.3--", "1.2.3-a..b", "1.2.3-a.", "1.2.3+a.", "1.2.3-0", "1.2.3+0",
+		"1.2.3-0a", "1.2.3-a.0", "1.2.3-042", "1.2.3+042", "1.2.3-", "1.2.3+", "1.2.3-.a", "1.2.3-a+", "1.2.3-a+b+c",
+		"1.2.3-ab*d", "1.2.3+ab*d", "1-extra", "1.2-extra", "1.2.3.4", "foo", "", "01.2.3", "1.02.3", "1.2.03",
+		" 1.2.3", "1.2.3 ", "1.2.3\n", "-1.2.3", "1..3", "1.2.3-\xe9",
+		"18446744073709551615.18446744073709551615.18446744073709551615",
+		"18446744073709551616.0.0", "0.18446744073709551616.0", "0.0.18446744073709551616",
+		"0.0.0-18446744073709551615", "0.0.0-18446744073709551616", "0.0.0+18446744073709551616",
+		"100000000000000000000000000.0.0", "0.0.0-100000000000000000000000000",
+		"0.0.0-100000000000000000000000000*", "01.0.0-100000000000000000000000000",
+	};
+
+	for (const auto& version : versions) {
+		BOOST_CHECK(check_same_as_regex(version));
+	}
+
+	// Random strings built from the characters that matter to the grammar
+	const std::string alphabet = "0123456789..--++azAZ*";
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<std::size_t> char_distribution(0, alphabet.size() - 1);
+	std::uniform_int_distribution<std::size_t> size_distribution(0, 8);
+
+	for (unsigned i = 0; i < 100000; ++i) {
+		std::string str = "1.2.3";
+		if (i % 2 == 0)
+			str.clear();
+
+		const auto size = size_distribution(generator);
+		for (std::size_t j = 0; j < size; ++j)
+			str += alphabet[char_distribution(generator)];
+
+		BOOST_CHECK(check_same_as_regex(str));
+	}
+}
+
 BOOST_AUTO_TEST_CASE(to_string)
 {
 	BOOST_CHECK(Version(1, 2, 3).to_string() == "1.2.3");
@@ -204,6 +336,38 @@ BOOST_AUTO_TEST_CASE(to_string)
 	);
 }
 
+BOOST_AUTO_TEST_CASE(to_chars)
+{
+	const std::vector<Version> versions{
+		Version(0), Version(1, 2, 3), Version(std::numeric_limits<std::uint64_t>::max(), 10, 100),
+		Version(1, 2, 3, {{"foo"}, {"bar"}, {42}}, {{"foo"}, {"bar"}, {42}}),
+		Version(1, 2, 3, {{std::string(100, 'a')}}),
+		Version::from_string("1.2.3-foo.42+bar"), Version::from_string("1.2.3-foo.42+bar", false),
+	};
+
+	for (const auto& version : versions) {
+		const auto str = version.to_string();
+
+		char buffer[256];
+		const auto size = version.to_chars(buffer, sizeof(buffer));
+		BOOST_REQUIRE_EQUAL(size, str.size());
+		BOOST_CHECK(std::string(buffer, size) == str);
+
+		// Too small buffers are filled with the beginning of the string
+		std::fill(std::begin(buffer), std::end(buffer), '#');
+		BOOST_CHECK_EQUAL(version.to_chars(buffer, 3), str.size());
+		BOOST_CHECK(std::string(buffer, 3) == str.substr(0, 3));
+		BOOST_CHECK(buffer[3] == '#');
+
+		BOOST_CHECK_EQUAL(version.to_chars(nullptr, 0), str.size());
+	}
+
+	BOOST_CHECK(versions[2].to_string() == "18446744073709551615.10.100");
+	BOOST_CHECK(versions[4].to_string() == "1.2.3-" + std::string(100, 'a'));
+	BOOST_CHECK(versions[5].to_string() == "1.2.3-foo.42+bar");
+	BOOST_CHECK(versions[6].to_string() == "1.2.3-foo.42+bar");
+}
+
 BOOST_AUTO_TEST_CASE(compare_equal)
 {
 	BOOST_CHECK(Version(1, 2, 3) == Version(1, 2, 3));
@@ -621,3 +785,154 @@ BOOST_AUTO_TEST_CASE(comparison)
 	BOOST_CHECK(Version::Comparison::FutureInFixes < Version::Comparison::FutureInFunctionalities);
 	BOOST_CHECK(Version::Comparison::FutureInFunctionalities < Version::Comparison::FutureIncompatible);
 }
+
+BOOST_AUTO_TEST_CASE(identifier_storage)
+{
+	const std::string short_str = "rc";
+	const std::string inline_str = "exactly-16-chars";
+	const std::string long_str = "a-rather-long-prerelease-identifier";
+
+	for (const auto& str : {short_str, inline_str, long_str, std::string()}) {
+		Version::Identifier id(str);
+		BOOST_CHECK(id.type() == Version::Identifier::Type::String);
+		BOOST_CHECK(id.str() == str);
+		BOOST_CHECK(id.to_string() == str);
+
+		Version::Identifier copy(id);
+		BOOST_CHECK(copy == id);
+		BOOST_CHECK(copy.str() == str);
+
+		Version::Identifier moved(std::move(copy));
+		BOOST_CHECK(moved == id);
+
+		Version::Identifier assigned(42);
+		assigned = id;
+		BOOST_CHECK(assigned == id);
+		assigned = Version::Identifier(long_str);
+		BOOST_CHECK(assigned.str() == long_str);
+		assigned = Version::Identifier(7);
+		BOOST_CHECK(assigned.type() == Version::Identifier::Type::Number);
+		BOOST_CHECK(assigned.number() == 7);
+	}
+
+	BOOST_CHECK(Version::Identifier(long_str) != Version::Identifier(long_str + "b"));
+	BOOST_CHECK(Version::Identifier(long_str) < Version::Identifier(long_str + "b"));
+	BOOST_CHECK((Version::Identifier(inline_str) < Version::Identifier(long_str)) == (inline_str < long_str));
+	BOOST_CHECK(Version::Identifier(42) != Version::Identifier("42"));
+	BOOST_CHECK(Version::Identifier(42) < Version::Identifier(""));
+
+	// Moved-from identifiers are empty alphanumeric identifiers, whatever they were
+	for (auto& id : {Version::Identifier(42), Version::Identifier(short_str), Version::Identifier(long_str)}) {
+		Version::Identifier moved_from(id);
+		Version::Identifier moved(std::move(moved_from));
+		BOOST_CHECK(moved == id);
+		BOOST_CHECK(moved_from.type() == Version::Identifier::Type::String);
+		BOOST_CHECK(moved_from.str().empty());
+
+		Version::Identifier assigned_from(id);
+		Version::Identifier assigned(7);
+		assigned = std::move(assigned_from);
+		BOOST_CHECK(assigned == id);
+		BOOST_CHECK(assigned_from.type() == Version::Identifier::Type::String);
+		BOOST_CHECK(assigned_from.str().empty());
+	}
+
+	std::vector<Version::Identifier> identifiers{{long_str}, {2}, {short_str}, {1}, {inline_str}};
+	std::sort(identifiers.begin(), identifiers.end());
+	BOOST_CHECK(Version::Identifier::to_string(identifiers) == "1.2.a-rather-long-prerelease-identifier."
+	                                                           "exactly-16-chars.rc");
+}
+
+namespace {
+
+// Version::operator< and operator== as they were before the sort key, used as the reference
+bool reference_less(const Version& a, const Version& b) {
+	const std::array<std::uint64_t, 3> a_numbers{{a.major(), a.minor(), a.patch()}};
+	const std::array<std::uint64_t, 3> b_numbers{{b.major(), b.minor(), b.patch()}};
+
+	if (a_numbers != b_numbers)
+		return a_numbers < b_numbers;
+
+	if (a.prerelease().empty() || b.prerelease().empty())
+		return !a.prerelease().empty() && b.prerelease().empty();
+
+	return a.prerelease() < b.prerelease();
+}
+
+bool reference_equal(const Version& a, const Version& b) {
+	return a.major() == b.major() && a.minor() == b.minor() && a.patch() == b.patch()
+	       && a.prerelease() == b.prerelease();
+}
+
+// Random versions around the limits of the sort key
+std::vector<Version> random_versions(std::size_t count) {
+	const std::uint64_t numbers[] = {
+		0, 1, 2, 42, 0xfffffffe, 0xffffffff, 0x100000000, (std::uint64_t(1) << 30) - 1, std::uint64_t(1) << 30,
+		std::uint64_t(1) << 40, std::numeric_limits<std::uint64_t>::max()
+	};
+	const char* const strings[] = {"", "-", "a", "ab", "abc", "abcd", "abd", "b", "rc", "A", "Z9", "alpha-1"};
+
+	std::mt19937 gen(42);
+	auto pick_number = [&]() { return numbers[gen() % (sizeof(numbers) / sizeof(numbers[0]))]; };
+	auto pick_identifiers = [&]() {
+		std::vector<Version::Identifier> identifiers;
+		for (auto i = gen() % 4; i > 0; --i) {
+			if (gen() % 2) {
+				identifiers.emplace_back(pick_number());
+			} else {
+				identifiers.emplace_back(strings[gen() % (sizeof(strings) / sizeof(strings[0]))]);
+			}
+		}
+		return identifiers;
+	};
+
+	std::vector<Version> versions;
+	for (std::size_t i = 0; i < count; ++i) {
+		// Mostly small numbers, so that a lot of versions only differ by their prerelease
+		auto small_or_picked = [&]() { return gen() % 4 ? gen() % 3 : pick_number(); };
+		versions.emplace_back(small_or_picked(), small_or_picked(), small_or_picked(), pick_identifiers(),
+		                      pick_identifiers());
+	}
+	return versions;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(sort_key_same_as_compare)
+{
+	const auto versions = random_versions(1500);
+
+	for (const auto& a : versions) {
+		for (const auto& b : versions) {
+			const bool less = reference_less(a, b);
+			const bool equal = reference_equal(a, b);
+
+			BOOST_REQUIRE_EQUAL(a < b, less);
+			BOOST_REQUIRE_EQUAL(a == b, equal);
+
+			if (a.sort_key() < b.sort_key()) {
+				BOOST_REQUIRE(less);
+			}
+			if (equal) {
+				BOOST_REQUIRE(a.sort_key() == b.sort_key());
+			}
+			if (a.sort_key() == b.sort_key() && a.sort_key().is_exact()) {
+				BOOST_REQUIRE(equal);
+			}
+		}
+	}
+
+	auto sorted = versions;
+	std::sort(sorted.begin(), sorted.end());
+	BOOST_CHECK(std::is_sorted(sorted.begin(), sorted.end(), reference_less));
+
+	for (const auto& version : versions) {
+		const auto it = std::lower_bound(sorted.begin(), sorted.end(), version);
+		BOOST_REQUIRE(it != sorted.end());
+		BOOST_CHECK(reference_equal(*it, version));
+	}
+
+	BOOST_CHECK(Version(1, 2, 3).sort_key().is_exact());
+	BOOST_CHECK(!Version(1, 2, 3, {{"rc"}}).sort_key().is_exact());
+	BOOST_CHECK(!Version(std::numeric_limits<std::uint64_t>::max()).sort_key().is_exact());
+}